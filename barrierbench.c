@@ -0,0 +1,72 @@
+// Measure kthread_barrier_wait latency with 2, 4, 8 and 16 threads:
+// the main thread and n-1 workers pass the same barrier ROUNDS times.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kthread.h"
+
+#define MAXTHREADS 16
+#define ROUNDS 1000
+
+int barrierid;
+
+void
+worker(void)
+{
+  int i;
+
+  for(i = 0; i < ROUNDS; i++)
+    kthread_barrier_wait(barrierid);
+  kthread_exit();
+}
+
+// Pass the barrier ROUNDS times with n threads; return the elapsed ticks.
+int
+run(int n)
+{
+  char *stacks[MAXTHREADS];
+  int tids[MAXTHREADS];
+  int i, start;
+
+  if((barrierid = kthread_barrier_alloc(n)) < 0){
+    printf(1, "barrierbench: barrier alloc failed\n");
+    exit();
+  }
+
+  for(i = 0; i < n - 1; i++){
+    stacks[i] = malloc(MAX_STACK_SIZE);
+    if((tids[i] = kthread_create(worker, stacks[i] + MAX_STACK_SIZE)) < 0){
+      printf(1, "barrierbench: kthread_create failed\n");
+      exit();
+    }
+  }
+
+  // Line everyone up before starting the clock.
+  kthread_barrier_wait(barrierid);
+  start = uptime();
+  for(i = 1; i < ROUNDS; i++)
+    kthread_barrier_wait(barrierid);
+  start = uptime() - start;
+
+  for(i = 0; i < n - 1; i++){
+    kthread_join(tids[i]);
+    free(stacks[i]);
+  }
+  kthread_barrier_dealloc(barrierid);
+  return start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, t;
+
+  printf(1, "barrierbench: %d rounds\n", ROUNDS - 1);
+  for(n = 2; n <= MAXTHREADS; n *= 2){
+    t = run(n);
+    printf(1, "%d threads: %d ticks, %d us per round\n",
+           n, t, t * 10000 / (ROUNDS - 1));
+  }
+  exit();
+}
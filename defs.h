@@ -5,7 +5,10 @@ struct inode;
 struct pipe;
 struct proc;
 struct thread;
+struct threadstats;
 struct kthread_mutex_t;
+struct lockstat;
+struct kthread_mutex_stats;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -79,6 +82,7 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(uchar, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -110,6 +114,7 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+void            killOtherThreads(void);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 struct thread*  mythread();
@@ -126,13 +131,43 @@ void            yield(void);
 void            lockPtable(void);
 void            releasePtable(void);
 int             kthread_create(void (*start_func)(), void* stack);
+int             kthread_create_stack(void (*start_func)(), int);
+int             kthread_settls(void*);
+int             kthread_setaffinity(int, int);
+int             kthread_getaffinity(int);
+int             kthread_setpriority(int, int);
+void            preempt(void);
+int             settickets(int);
+int             getthreadstats(int, struct threadstats*);
+void            boostprio(void);
 int             kthread_id();
 void            kthread_exit();
 int             kthread_join(int thread_id);
 int             kthread_mutex_alloc();
+int             kthread_mutex_alloc_mode(int mode);
 int             kthread_mutex_dealloc(int mutex_id);
 int             kthread_mutex_lock(int mutex_id);
 int             kthread_mutex_unlock(int mutex_id);
+int             kthread_mutex_stats(int mutex_id, struct kthread_mutex_stats *buf);
+int             kthread_rwlock_alloc();
+int             kthread_rwlock_dealloc(int rwlock_id);
+int             kthread_rwlock_rdlock(int rwlock_id);
+int             kthread_rwlock_wrlock(int rwlock_id);
+int             kthread_rwlock_unlock(int rwlock_id);
+int             kthread_cond_alloc();
+int             kthread_cond_dealloc(int cond_id);
+int             kthread_cond_wait(int cond_id, int mutex_id);
+int             kthread_cond_signal(int cond_id);
+int             kthread_cond_broadcast(int cond_id);
+int             kthread_sem_alloc(int value);
+int             kthread_sem_dealloc(int sem_id);
+int             kthread_sem_down(int sem_id);
+int             kthread_sem_up(int sem_id);
+int             kthread_barrier_alloc(int nthreads);
+int             kthread_barrier_dealloc(int barrier_id);
+int             kthread_barrier_wait(int barrier_id);
+int             futex_wait(int *addr, int expected);
+int             futex_wake(int *addr, int n);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -140,9 +175,11 @@ void            swtch(struct context**, struct context*);
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
+int             getlockstat(struct lockstat*, int);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             setlockstat(int);
 void            pushcli(void);
 void            popcli(void);
 
@@ -195,9 +232,11 @@ void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*, struct thread*);
+void            loadtls(struct thread*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             checkuvm(pde_t*, uint, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -12,7 +12,7 @@ int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, tid;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
@@ -22,36 +22,21 @@ exec(char *path, char **argv)
   struct thread *currthread = mythread();
   struct thread *t;
 
+  // Kill and join every other thread.  Look the next one up
+  // under the lock, since kthread_join unlinks it from the list.
   for(;;) {
-      lockPtable();
-
-      for (t = curproc->pthreads; t < &curproc->pthreads[NTHREAD]; t++) {
-          if (t->tid != currthread->tid)
-              t->killed = 1;
-          if (t->state == SLEEPING) {
-              t->state = RUNNABLE;
-          }
-      }
-
-      releasePtable();
-
-      for (t = curproc->pthreads; t < &curproc->pthreads[NTHREAD]; t++) {
-          if (t->tid != currthread->tid) {
-              kthread_join(t->tid);
-          }
-      }
-      lockPtable();
-
-      for (t = curproc->pthreads; t < &curproc->pthreads[NTHREAD]; t++) {
-          if (currthread->tid != t->tid && t->state != T_UNUSED && t->state != T_ZOMBIE)
-              goto found;
-      }
-      releasePtable();
-
-      break;
-
-      found:
-      continue;
+      killOtherThreads();
+
+      acquire(&curproc->lock);
+      for (t = curproc->threads; t && t == currthread; t = t->pnext)
+          ;
+      tid = t ? t->tid : 0;
+      release(&curproc->lock);
+
+      if (tid == 0)
+          break;
+      if (kthread_join(tid) < 0 && curproc->killed)
+          return -1;
   }
   begin_op();
 
@@ -131,6 +116,13 @@ exec(char *path, char **argv)
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  if(curproc->ustacks){
+    kfree((char*)curproc->ustacks);
+    curproc->ustacks = 0;
+  }
+  currthread->ustack = -1;
+  currthread->tls = 0;
+  currthread->tf->gs = 0;
   currthread->tf->eip = elf.entry;  // main
   currthread->tf->esp = sp;
   switchuvm(curproc, currthread);
@@ -1,5 +1,30 @@
 #define MAX_STACK_SIZE 4000
-#define MAX_MUTEXES 64
+#define MAX_USTACK_SIZE (1024*1024)  // largest stack kthread_create_stack() maps
+#define MAX_MUTEXES 4096   // power of two; mutex ids encode a slot below it
+
+// Mutex modes for kthread_mutex_alloc_mode().
+#define MUTEX_BLOCKING 0   // sleep as soon as the mutex is held
+#define MUTEX_ADAPTIVE 1   // spin while the owner runs, then sleep
+
+#define MAX_RWLOCKS 64
+#define MAX_CONDS 64
+#define MAX_SEMS 64
+#define MAX_BARRIERS 64
+
+// Counts for one mutex, from kthread_mutex_stats().  They start
+// at zero when the mutex is allocated.
+struct kthread_mutex_stats {
+  uint nlock;          // Successful kthread_mutex_lock() calls
+  uint ncontend;       // Of those, how many found the mutex held
+  uint nunlock;        // Successful kthread_mutex_unlock() calls
+  uint nwoken;         // Waiters woken by those unlocks
+  uint64 waitcycles;   // rdtsc cycles contended lockers waited, in total
+  uint64 maxwait;      // Longest single wait
+};
+
+// Priority levels for kthread_setpriority(); lower runs first.
+#define KTHREAD_PRIO_MAX 0
+#define KTHREAD_PRIO_MIN 2
 
 
 /********************************
@@ -7,11 +32,39 @@
  ********************************/
 
 int kthread_create(void (*start_func)(), void* stack);
+int kthread_create_stack(void (*start_func)(), int size);
 int kthread_id();
+int kthread_settls(void *base);
 void kthread_exit();
 int kthread_join(int thread_id);
+int kthread_setaffinity(int thread_id, int mask);
+int kthread_getaffinity(int thread_id);
+int kthread_setpriority(int thread_id, int prio);
 
 int kthread_mutex_alloc();
+int kthread_mutex_alloc_mode(int mode);
 int kthread_mutex_dealloc(int mutex_id);
 int kthread_mutex_lock(int mutex_id);
-int kthread_mutex_unlock(int mutex_id);
\ No newline at end of file
+int kthread_mutex_unlock(int mutex_id);
+int kthread_mutex_stats(int mutex_id, struct kthread_mutex_stats *buf);
+
+int kthread_rwlock_alloc();
+int kthread_rwlock_dealloc(int rwlock_id);
+int kthread_rwlock_rdlock(int rwlock_id);
+int kthread_rwlock_wrlock(int rwlock_id);
+int kthread_rwlock_unlock(int rwlock_id);
+
+int kthread_cond_alloc();
+int kthread_cond_dealloc(int cond_id);
+int kthread_cond_wait(int cond_id, int mutex_id);
+int kthread_cond_signal(int cond_id);
+int kthread_cond_broadcast(int cond_id);
+
+int kthread_sem_alloc(int value);
+int kthread_sem_dealloc(int sem_id);
+int kthread_sem_down(int sem_id);
+int kthread_sem_up(int sem_id);
+
+int kthread_barrier_alloc(int nthreads);
+int kthread_barrier_dealloc(int barrier_id);
+int kthread_barrier_wait(int barrier_id);
@@ -0,0 +1,45 @@
+// Dump kernel spinlock contention, worst first by total spin time.
+// usage: lockstat [n]   show the top n lock names (default 10)
+//        lockstat on|off   start or stop collecting
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockstat stats[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat tmp;
+  int i, j, n, top;
+
+  if(argc > 1 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)){
+    setlockstat(strcmp(argv[1], "on") == 0);
+    exit();
+  }
+
+  top = argc > 1 ? atoi(argv[1]) : 10;
+  if((n = getlockstat(stats, NLOCKSTAT)) < 0){
+    printf(2, "lockstat: getlockstat failed\n");
+    exit();
+  }
+
+  for(i = 1; i < n; i++){
+    tmp = stats[i];
+    for(j = i; j > 0 && stats[j-1].spincycles < tmp.spincycles; j--)
+      stats[j] = stats[j-1];
+    stats[j] = tmp;
+  }
+
+  // printf has no 64-bit conversions, so cycles are shown in
+  // units of 1024 (kcyc).
+  printf(1, "name locks acquire contended spin(kcyc) maxhold(kcyc)\n");
+  for(i = 0; i < n && i < top; i++)
+    printf(1, "%s %d %d %d %d %d\n", stats[i].name, stats[i].nlock,
+           stats[i].nacquire, stats[i].ncontend,
+           (uint)(stats[i].spincycles >> 10), (uint)(stats[i].maxhold >> 10));
+  exit();
+}
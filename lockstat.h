@@ -0,0 +1,13 @@
+// Contention counts for kernel spinlocks, returned by getlockstat().
+// Locks are counted per name, so e.g. every process's "proc" lock
+// shares one entry.  Cycles are rdtsc cycles.  Only nlock is kept
+// up to date all the time; the rest count while setlockstat(1) is
+// in effect.
+struct lockstat {
+  char name[16];
+  uint nlock;          // Spinlocks initialised with this name
+  uint nacquire;       // Acquisitions
+  uint ncontend;       // Acquisitions that had to spin
+  uint64 spincycles;   // Cycles spent spinning, in total
+  uint64 maxhold;      // Longest time one lock was held
+};
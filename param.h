@@ -1,6 +1,13 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define CPUMASK_ALL  ((1 << NCPU) - 1)  // affinity mask allowing every cpu
+#define NWAITQ       61  // buckets in the sleeping-thread hash table
+#define NKSTACKCACHE  8  // freed kernel stacks each CPU keeps for reuse
+#define NPRIO         3  // MLFQ priority levels; KTHREAD_PRIO_MIN + 1
+#define BOOSTTICKS  100  // ticks between MLFQ priority boosts
+#define STRIDE1   (1<<16)  // stride of a process with one ticket
+#define DEFTICKETS  100  // tickets of a new process
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -10,5 +17,6 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define NLOCKSTAT    64  // spinlock names tracked by lockstat
+#define FSSIZE       2000  // size of file system in blocks
 
@@ -6,29 +6,86 @@
 #include "x86.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "traps.h"
 #include "kthread.h"
-
-// static struct kthread_mutex_t mutex_arr[MAX_MUTEXES];   // Global static array to hold the mutex objects
+#include "threadstats.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct thread *waitq[NWAITQ];   // SLEEPING threads, hashed by chan
+  uint boostgen;                  // Priority boosts so far
+  uint passfloor;                 // Highest stride pass picked so far
 } ptable;
 
 static struct proc *initproc;
 
+// Mutexes live in pages carved out on demand.  A mutex id is
+// gen * MAX_MUTEXES + slot, so lookup indexes the slot directly
+// and the generation, bumped on every alloc, rejects stale ids.
+#define MUTEXES_PER_PAGE (PGSIZE / sizeof(struct kthread_mutex_t))
+#define MUTEX_NPAGES ((MAX_MUTEXES + MUTEXES_PER_PAGE - 1) / MUTEXES_PER_PAGE)
+#define MUTEX_MAXGEN (0x7fffffff / MAX_MUTEXES)
+
 struct {
   struct spinlock lock;
-	struct kthread_mutex_t mutex_arr[MAX_MUTEXES];
+  struct kthread_mutex_t *pages[MUTEX_NPAGES];
+  int nslots;                          // Slots carved out so far
+  struct kthread_mutex_t *freelist;    // Deallocated slots
 } mtable;
 
+// Lock order: p->lock, mtable.lock, rwtable.lock, semtable.lock or
+// barriertable.lock, then ptable.lock;
+// condtable.lock comes before mtable.lock.
+//
+// p->lock guards the list p->threads: linking in a new thread,
+// marking a thread T_ZOMBIE, and unlinking a reaped one.  Once a
+// process is ZOMBIE no thread of it is left to race with wait(),
+// which reaps the rest of the list under ptable.lock alone.
+// ptable.lock guards every move into or out of RUNNABLE, RUNNING
+// and SLEEPING, the run queues, the wait-channel table and proc
+// state; it must be the only lock held when calling sched().
+// sleep(chan, &p->lock) is fine: sleep takes ptable.lock before
+// it drops p->lock, so a T_ZOMBIE set under p->lock can't be missed.
+// A T_ZOMBIE thread keeps running on its kernel stack until it
+// has swtch'ed away, which happens before ptable.lock is released,
+// so a reaper must acquire ptable.lock before freeing t->kstack.
+
+struct {
+  struct spinlock lock;
+  struct kthread_rwlock_t rwlock[MAX_RWLOCKS];
+} rwtable;
+
+struct {
+  struct spinlock lock;
+  struct kthread_cond_t cond[MAX_CONDS];
+} condtable;
+
+struct {
+  struct spinlock lock;
+  struct kthread_sem_t sem[MAX_SEMS];
+} semtable;
+
+struct {
+  struct spinlock lock;
+  struct kthread_barrier_t barrier[MAX_BARRIERS];
+} barriertable;
+
+// Pool of thread structures, carved out of kalloc'd pages as
+// needed and never given back, so a stale pointer to a thread
+// (e.g. in a run queue) always points at a struct thread.
+struct {
+  struct spinlock lock;
+  struct thread *free;             // Unused threads, linked through pnext
+} ttable;
+
 int nextpid = 1;
 int nexttid = 1;
-int nextmid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void procstats(struct proc *p, struct threadstats *st);
 
 void lockPtable(void){
   acquire(&ptable.lock);
@@ -38,39 +95,26 @@ void releasePtable(void){
   release(&ptable.lock);
 }
 
-int countRunnableThreads(struct proc *p)
+void
+pinit(void)
 {
-  struct thread *t;
-  int counter = 0;
-  //Loop over threads table looking for threads
-  for (t = p->pthreads; t < &p->pthreads[NTHREAD]; t++) {
-		if (t->state != T_UNUSED && t->state != T_ZOMBIE)
-			counter++;
-		else {
-			t->killed = 1;
-  	}
-	}
-  return counter;
-}
-
-void finishAllThreads(){
-  struct proc *curproc = myproc();
-  
-      if(!holding(&ptable.lock)) {
-      acquire(&ptable.lock);
-    }
+  struct proc *p;
 
-  while( countRunnableThreads(curproc) > 1){
-	wakeup1(curproc);
-	sleep(curproc, &ptable.lock);
-  }
-  release(&ptable.lock);
+  initlock(&ptable.lock, "ptable");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->lock, "proc");
+  initlock(&mtable.lock, "mtable");
+  initlock(&rwtable.lock, "rwtable");
+  initlock(&condtable.lock, "condtable");
+  initlock(&semtable.lock, "semtable");
+  initlock(&barriertable.lock, "barriertable");
+  initlock(&ttable.lock, "ttable");
 }
 
-void
-pinit(void)
+static int
+alloctid(void)
 {
-  initlock(&ptable.lock, "ptable");
+  return __sync_fetch_and_add(&nexttid, 1);
 }
 
 // Must be called with interrupts disabled
@@ -125,12 +169,401 @@ mythread(void) {
 
 struct thread* searchThreadByStatus(struct proc *p, enum threadstate state) {
 	struct thread *t;
-	for(t = p->pthreads; t < &p->pthreads[NTHREAD]; t++)
+	for(t = p->threads; t; t = t->pnext)
 		if (t->state == state)
 			return t;
 	return 0;
 }
 
+// Append t to the tail of c's run queue for its priority.
+// A thread is on at most one queue; queueing it again is a no-op.
+// The ptable lock must be held.
+static void
+rqpush(struct cpu *c, struct thread *t)
+{
+  struct runqueue *q = &c->rq[t->prio];
+
+  if(t->rqcpu)
+    return;
+  t->rqnext = 0;
+  if(q->tail)
+    q->tail->rqnext = t;
+  else
+    q->head = t;
+  q->tail = t;
+  q->len++;
+  c->rqlen++;
+  t->rqcpu = c;
+}
+
+// Unlink t, which follows prev (or is the head if prev is 0),
+// from c's run queue for priority prio.
+// The ptable lock must be held.
+static void
+rqunlink(struct cpu *c, int prio, struct thread *prev, struct thread *t)
+{
+  struct runqueue *q = &c->rq[prio];
+
+  if(prev)
+    prev->rqnext = t->rqnext;
+  else
+    q->head = t->rqnext;
+  if(q->tail == t)
+    q->tail = prev;
+  q->len--;
+  c->rqlen--;
+  t->rqnext = 0;
+  t->rqcpu = 0;
+}
+
+// Remove and return the thread at the head of c's run queue
+// for priority prio.
+// The ptable lock must be held.
+static struct thread*
+rqpop(struct cpu *c, int prio)
+{
+  struct thread *t;
+
+  if((t = c->rq[prio].head) != 0)
+    rqunlink(c, prio, 0, t);
+  return t;
+}
+
+// Stride scheduling: a process's pass advances by its stride,
+// STRIDE1 / tickets, for every tick one of its threads runs,
+// and the lowest pass runs next.  All threads of a process share
+// its pass, so its tickets are split among them.  A process that
+// was asleep or is new starts at passfloor, not with the credit
+// it would otherwise have built up.
+// The ptable lock must be held.
+static int
+passbefore(struct proc *a, struct proc *b)
+{
+  return (int)(a->pass - b->pass) < 0;
+}
+
+static void
+passcatchup(struct proc *p)
+{
+  if((int)(p->pass - ptable.passfloor) < 0)
+    p->pass = ptable.passfloor;
+}
+
+// Reset t to its base priority if a boost happened since
+// it last looked.  Boosts only requeue queued threads, so
+// running and sleeping ones catch up here.
+// The ptable lock must be held.
+static void
+syncprio(struct thread *t)
+{
+  if(t->boostgen != ptable.boostgen){
+    t->boostgen = ptable.boostgen;
+    t->prio = t->baseprio;
+  }
+}
+
+static int
+cpuallowed(struct thread *t, struct cpu *c)
+{
+  return (t->affinity >> (c - cpus)) & 1;
+}
+
+// The cpu whose run queue t should join: the one it last ran on,
+// or this cpu if it has not run yet, unless its affinity mask
+// rules that out, in which case the first cpu the mask allows.
+// If another allowed queue is shorter by two or more, t goes
+// there instead: a busy cpu never goes idle to steal, so without
+// this threads stuck behind a longer queue get a smaller share.
+static struct cpu*
+rqtarget(struct thread *t)
+{
+  struct cpu *c, *v;
+
+  c = t->cpu ? t->cpu : mycpu();
+  if(!cpuallowed(t, c)){
+    for(c = cpus; c < &cpus[ncpu]; c++)
+      if(cpuallowed(t, c))
+        break;
+    if(c == &cpus[ncpu])
+      return mycpu();
+  }
+  for(v = cpus; v < &cpus[ncpu]; v++)
+    if(cpuallowed(t, v) && v->rqlen + 1 < c->rqlen)
+      c = v;
+  return c;
+}
+
+// Queue t on c, unless c has other work and some cpu t may use
+// is halted, in which case queue it there instead, so it does not
+// wait a tick for that cpu to wake and steal it.  Kick the chosen
+// cpu out of hlt.
+// The ptable lock must be held.
+static void
+rqplace(struct cpu *c, struct thread *t)
+{
+  struct cpu *v;
+
+  if(!c->idle && (c->rqlen > 0 || (c->thread && c->thread != t))){
+    for(v = cpus; v < &cpus[ncpu]; v++){
+      if(v->idle && cpuallowed(t, v)){
+        c = v;
+        break;
+      }
+    }
+  }
+  rqpush(c, t);
+  if(c->idle && c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// Mark t RUNNABLE and queue it through rqplace(rqtarget(t)).
+// The ptable lock must be held.
+static void
+makerunnable(struct thread *t)
+{
+  t->state = RUNNABLE;
+  t->readyat = ticks;
+  syncprio(t);
+  rqplace(rqtarget(t), t);
+}
+
+static struct thread**
+waitqbucket(void *chan)
+{
+  return &ptable.waitq[((uint)chan >> 2) % NWAITQ];
+}
+
+// Unlink the SLEEPING thread t from its wait-channel bucket.
+// The ptable lock must be held.
+static void
+waitqremove(struct thread *t)
+{
+  struct thread **pp;
+
+  for(pp = waitqbucket(t->chan); *pp; pp = &(*pp)->chnext){
+    if(*pp == t){
+      *pp = t->chnext;
+      t->chnext = 0;
+      return;
+    }
+  }
+  panic("waitqremove");
+}
+
+// Wake t from sleep regardless of its chan, e.g. when it is killed.
+// The ptable lock must be held.
+static void
+wakethread(struct thread *t)
+{
+  waitqremove(t);
+  makerunnable(t);
+}
+
+// Take the next thread off c's run queue that may run on cpu to:
+// from the highest non-empty priority level, the one whose process
+// has the lowest stride pass, the earliest queued among equals.
+// Entries whose slot was freed or reused since they were queued
+// are dropped; threads of a process that is not INUSED stay queued.
+// A thread whose affinity changed while queued on c moves to a
+// cpu it allows; one that to may not steal stays on c.
+// The ptable lock must be held.
+static struct thread*
+pickthread(struct cpu *c, struct cpu *to)
+{
+  struct thread *t, *next, *prev, *best, *bestprev;
+  int prio;
+
+  for(prio = 0; prio < NPRIO; prio++){
+    best = bestprev = prev = 0;
+    for(t = c->rq[prio].head; t; t = next){
+      next = t->rqnext;
+      if(t->state != RUNNABLE){
+        rqunlink(c, prio, prev, t);
+        continue;
+      }
+      if(t->proc->state != INUSED)
+        ;
+      else if(!cpuallowed(t, to)){
+        if(c == to || !cpuallowed(t, c)){
+          rqunlink(c, prio, prev, t);
+          rqplace(rqtarget(t), t);
+          continue;
+        }
+      } else if(best == 0 || passbefore(t->proc, best->proc)){
+        best = t;
+        bestprev = prev;
+      }
+      prev = t;
+    }
+    if(best){
+      rqunlink(c, prio, bestprev, best);
+      if((int)(best->proc->pass - ptable.passfloor) > 0)
+        ptable.passfloor = best->proc->pass;
+      return best;
+    }
+  }
+  return 0;
+}
+
+// Called by an idle cpu: take a runnable thread from the
+// cpu with the longest run queue, so threads created or woken
+// on one cpu spread over all of them.
+// The ptable lock must be held.
+static struct thread*
+stealthread(struct cpu *c)
+{
+  struct cpu *v, *victim;
+  struct thread *t;
+  uint tried;
+
+  // Threads pinned away from c stay put, so fall back to
+  // shorter queues when the longest has nothing c may run.
+  for(tried = 0;; tried |= 1 << (victim - cpus)){
+    victim = 0;
+    for(v = cpus; v < &cpus[ncpu]; v++){
+      if(v == c || v->rqlen == 0 || (tried >> (v - cpus)) & 1)
+        continue;
+      if(victim == 0 || v->rqlen > victim->rqlen)
+        victim = v;
+    }
+    if(victim == 0)
+      return 0;
+    if((t = pickthread(victim, c)) != 0)
+      break;
+  }
+  c->nsteal++;
+  victim->nstolen++;
+  return t;
+}
+
+// Give t a kernel stack, from this cpu's cache of freed stacks
+// when possible so that thread creation skips kmem.lock, and lay
+// out the trap frame and a context that starts at forkret, which
+// returns to trapret.  The caller fills in *t->tf.
+static int
+allockstack(struct thread *t)
+{
+  struct cpu *c;
+  char *sp;
+
+  pushcli();
+  c = mycpu();
+  t->kstack = c->nkstack > 0 ? c->kstacks[--c->nkstack] : 0;
+  popcli();
+  if(t->kstack == 0 && (t->kstack = kalloc()) == 0)
+    return -1;
+  sp = t->kstack + KSTACKSIZE;
+
+  // Leave room for trap frame.
+  sp -= sizeof *t->tf;
+  t->tf = (struct trapframe *) sp;
+
+  sp -= 4;
+  *(uint *) sp = (uint) trapret;
+
+  sp -= sizeof *t->context;
+  t->context = (struct context *) sp;
+  memset(t->context, 0, sizeof *t->context);
+  t->context->eip = (uint) forkret;
+  return 0;
+}
+
+// Return a reaped thread's kernel stack to this cpu's cache,
+// or to kalloc if the cache is full.
+static void
+freekstack(char *kstack)
+{
+  struct cpu *c;
+
+  pushcli();
+  c = mycpu();
+  if(c->nkstack < NKSTACKCACHE){
+    c->kstacks[c->nkstack++] = kstack;
+    kstack = 0;
+  }
+  popcli();
+  if(kstack)
+    kfree(kstack);
+}
+
+// Take a thread from the pool, carving a fresh page of them if
+// it is empty, and link it into p->threads as T_EMBRYO.
+// The caller must hold p->lock, unless p is still EMBRYO.
+static struct thread*
+allocthread(struct proc *p)
+{
+  struct thread *t;
+  char *page;
+
+  if(p->nthread >= NTHREAD)
+    return 0;
+
+  acquire(&ttable.lock);
+  if(ttable.free == 0){
+    if((page = kalloc()) == 0){
+      release(&ttable.lock);
+      return 0;
+    }
+    memset(page, 0, PGSIZE);
+    for(t = (struct thread*)page; t + 1 <= (struct thread*)(page + PGSIZE); t++){
+      t->pnext = ttable.free;
+      ttable.free = t;
+    }
+  }
+  t = ttable.free;
+  ttable.free = t->pnext;
+  release(&ttable.lock);
+
+  // rqcpu and rqnext are left alone: a stale run-queue entry
+  // may still point here, and pickthread() will drop it.
+  t->state = T_EMBRYO;
+  t->tid = alloctid();
+  t->proc = p;
+  t->killed = 0;
+  t->cpu = 0;
+  t->kstack = 0;
+  t->chan = 0;
+  t->mwait = 0;
+  t->mnext = 0;
+  t->ustack = -1;
+  t->tls = 0;
+  t->affinity = CPUMASK_ALL;
+  t->prio = t->baseprio = 0;
+  t->boostgen = ptable.boostgen;
+  t->runticks = t->waitticks = 0;
+  t->nvcsw = t->nivcsw = 0;
+  t->pnext = p->threads;
+  p->threads = t;
+  p->nthread++;
+  return t;
+}
+
+// Unlink t from its process and return it to the pool.
+// Its kernel stack must already be freed.  The caller must hold
+// t->proc->lock, unless the process is EMBRYO or ZOMBIE.
+static void
+freethread(struct thread *t)
+{
+  struct proc *p = t->proc;
+  struct thread **pp;
+
+  for(pp = &p->threads; *pp; pp = &(*pp)->pnext){
+    if(*pp == t){
+      *pp = t->pnext;
+      p->nthread--;
+      break;
+    }
+  }
+  t->state = T_UNUSED;
+  t->tid = 0;
+  t->killed = 0;
+
+  acquire(&ttable.lock);
+  t->pnext = ttable.free;
+  ttable.free = t;
+  release(&ttable.lock);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -139,7 +572,6 @@ struct thread* searchThreadByStatus(struct proc *p, enum threadstate state) {
 static struct proc*
 allocproc(void) {
 	struct proc *p;
-	char *sp;
 	struct thread *t;
 
 	if(!holding(&ptable.lock)) {
@@ -156,41 +588,26 @@ allocproc(void) {
 	found:
 	p->state = EMBRYO;
 	p->pid = nextpid++;
+	p->tickets = DEFTICKETS;
+	p->stride = STRIDE1 / DEFTICKETS;
+	p->pass = ptable.passfloor;
+	p->runticks = p->waitticks = 0;
+	p->nvcsw = p->nivcsw = 0;
+	p->ustacks = 0;
 
 	release(&ptable.lock);
 
-	//init thread state of all thread to UNUSED
-	for (t = p->pthreads; t < &p->pthreads[NTHREAD]; t++) {
-		t->state = T_UNUSED;
+	if ((t = allocthread(p)) == 0) {
+		p->state = UNUSED;
+		return 0;
 	}
 
-	t = searchThreadByStatus(p, T_UNUSED);
-	t->state = T_EMBRYO;
-	t->tid = nexttid++;
-	t->proc = p;
-	t->killed = 0;
-
 	// Allocate kernel stack.
-	if ((t->kstack = kalloc()) == 0) {
-		t->state = T_UNUSED;
+	if (allockstack(t) < 0) {
+		freethread(t);
     p->state=UNUSED; // todo CHANGED
 		return 0;
 	}
-	sp = t->kstack + KSTACKSIZE;
-
-	// Leave room for trap frame.
-	sp -= sizeof *t->tf;
-	t->tf = (struct trapframe *) sp;
-
-	// Set up new context to start executing at forkret,
-	// which returns to trapret.
-	sp -= 4;
-	*(uint *) sp = (uint) trapret;
-
-	sp -= sizeof *t->context;
-	t->context = (struct context *) sp;
-	memset(t->context, 0, sizeof *t->context);
-	t->context->eip = (uint) forkret;
 
 	return p;
 }
@@ -232,7 +649,7 @@ userinit(void) {
     }
 
 	p->state = INUSED;
-	t->state = RUNNABLE;
+	makerunnable(t);
 
 	release(&ptable.lock);
 }
@@ -240,31 +657,119 @@ userinit(void) {
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
-growproc(int n) { // todo need to be synced
+growproc(int n) {
 	uint sz;
 	struct proc *curproc = myproc();
+	struct ustack *us;
 
-
+	acquire(&curproc->lock);
 	sz = curproc->sz;
 	if (n > 0) {
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&curproc->lock);
 			return -1;
+    }
 	} else if (n < 0) {
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Don't shrink into a thread's stack, or to inside a region
+    // or its guard page, which would leave unmapped holes below
+    // the new size.  Forget free regions wholly above it.
+    for(us = curproc->ustacks; us && us < &curproc->ustacks[NUSTACK]; us++){
+      if(us->size == 0 || us->base + us->size <= sz + n)
+        continue;
+      if(us->inuse || sz + n > us->base - PGSIZE){
+        release(&curproc->lock);
+        return -1;
+      }
+      us->size = 0;
+    }
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&curproc->lock);
 			return -1;
+    }
   }
 	curproc->sz = sz;
 	switchuvm(curproc, mythread());
+	release(&curproc->lock);
 	return 0;
 }
 
+// Map a user stack of npages pages for a new thread of p.
+// Reuses the smallest free region that fits, mapping more of it
+// if needed, otherwise grows p->sz by the stack plus an unmapped
+// guard page below it.
+// Returns the index in p->ustacks, or -1 if out of memory or
+// all NUSTACK regions are in use.
+// The caller must hold p->lock.
+static int
+allocustack(struct proc *p, uint npages)
+{
+  struct ustack *us, *best, *empty;
+  uint base, top;
+
+  if(p->ustacks == 0){
+    if((p->ustacks = (struct ustack*)kalloc()) == 0)
+      return -1;
+    memset(p->ustacks, 0, PGSIZE);
+  }
+
+  best = empty = 0;
+  for(us = p->ustacks; us < &p->ustacks[NUSTACK]; us++){
+    if(us->size == 0){
+      if(empty == 0)
+        empty = us;
+    } else if(!us->inuse && us->size >= npages*PGSIZE){
+      if(best == 0 || us->size < best->size)
+        best = us;
+    }
+  }
+
+  if(best){
+    if(best->npages < npages){
+      top = best->base + best->size;
+      if(allocuvm(p->pgdir, top - npages*PGSIZE,
+                  top - best->npages*PGSIZE) == 0)
+        return -1;
+      best->npages = npages;
+    }
+    best->inuse = 1;
+    return best - p->ustacks;
+  }
+
+  if(empty == 0)
+    return -1;
+  base = PGROUNDUP(p->sz) + PGSIZE;
+  if(base < p->sz || base + npages*PGSIZE >= KERNBASE)
+    return -1;
+  if(allocuvm(p->pgdir, base, base + npages*PGSIZE) == 0)
+    return -1;
+  empty->base = base;
+  empty->size = npages*PGSIZE;
+  empty->npages = npages;
+  empty->inuse = 1;
+  p->sz = base + npages*PGSIZE;
+  return empty - p->ustacks;
+}
+
+// Give user stack i back for a later thread to reuse.  Its pages
+// stay mapped: lcr3 here would not flush the TLBs of other cpus
+// running threads of p, so unmapping would let them write into
+// freed pages.
+// The caller must hold p->lock.
+static void
+freeustack(struct proc *p, int i)
+{
+  p->ustacks[i].inuse = 0;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void) {
-	int i, pid;
+	int i, pid, haveustacks;
+	uint top;
 	struct proc *np;
+	struct ustack *us;
 	struct proc *curproc = myproc();
 	struct thread *currthread = mythread();
 
@@ -275,17 +780,47 @@ fork(void) {
 
 	struct thread *nt = searchThreadByStatus(np, T_EMBRYO);
 
-	// Copy process state from proc.
-	if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0) {
-		kfree(nt->kstack);
+	// Copy process state from proc.  Holding curproc->lock keeps
+	// other threads from resizing memory or unmapping stacks meanwhile.
+	acquire(&curproc->lock);
+	np->pgdir = copyuvm(curproc->pgdir, curproc->sz);
+	np->sz = curproc->sz;
+	if (curproc->ustacks && (np->ustacks = (struct ustack*)kalloc()) != 0)
+		memmove(np->ustacks, curproc->ustacks, PGSIZE);
+	haveustacks = curproc->ustacks != 0;
+	release(&curproc->lock);
+	if (np->pgdir == 0 || (haveustacks && np->ustacks == 0)) {
+		if (np->pgdir)
+			freevm(np->pgdir);
+		if (np->ustacks)
+			kfree((char*)np->ustacks);
+		np->pgdir = 0;
+		np->ustacks = 0;
+		freekstack(nt->kstack);
 		nt->kstack = 0;
+		freethread(nt);
 		np->state = UNUSED;
-		nt->state = T_UNUSED;
 		return -1;
 	}
-	np->sz = curproc->sz;
+	// Only the forking thread lives on in the child, so the other
+	// stacks could never be joined there.  Unmap them and free
+	// their regions; the child's pgdir is not loaded anywhere yet.
+	for (us = np->ustacks; us && us < &np->ustacks[NUSTACK]; us++) {
+		if (us->size == 0 || us - np->ustacks == currthread->ustack)
+			continue;
+		top = us->base + us->size;
+		deallocuvm(np->pgdir, top, top - us->npages*PGSIZE);
+		us->npages = 0;
+		us->inuse = 0;
+	}
 	np->parent = curproc;
+	np->tickets = curproc->tickets;
+	np->stride = curproc->stride;
 	*nt->tf = *currthread->tf;
+	nt->ustack = currthread->ustack;
+	nt->tls = currthread->tls;
+	nt->affinity = currthread->affinity;
+	nt->prio = nt->baseprio = currthread->baseprio;
 
 	// Clear %eax so that fork returns 0 in the child.
 	nt->tf->eax = 0;
@@ -302,7 +837,7 @@ fork(void) {
       acquire(&ptable.lock);
     }
 
-	nt->state = RUNNABLE;
+	makerunnable(nt);
 	np->state = INUSED;
 
 	release(&ptable.lock);
@@ -314,12 +849,9 @@ fork(void) {
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
 void
-exit(void) {  struct proc *curproc = myproc();
+exit(void) {
+  struct proc *curproc = myproc();
   struct thread *curthread = mythread();
-  struct proc *p;
-  int fd;
-  struct thread *t;
-
 
   if(curproc == initproc)
     panic("init exiting");
@@ -327,66 +859,24 @@ exit(void) {  struct proc *curproc = myproc();
   if(curthread->killed)
     kthread_exit();
 
+  // Kill the other threads and exit this one.  The last thread
+  // to exit closes the files and makes the process a ZOMBIE.
   kill(curproc->pid);
+  kthread_exit();
+}
 
-  acquire(&ptable.lock);
-
-  int allZombies = 1;
-  for (int i =0; i<NTHREAD; i++){
-    t = &curproc->pthreads[i];
-    if(t->tid !=mythread()->tid &&( t->state != T_ZOMBIE && t->state != T_UNUSED))
-      allZombies = 0;
-  }
-
-  if(allZombies)//this is the last thread to exit!
-  {
-    release(&ptable.lock);
-
-    // Close all open files.
-    for(fd = 0; fd < NOFILE; fd++){
-      if(curproc->ofile[fd]){
-        fileclose(curproc->ofile[fd]);
-        curproc->ofile[fd] = 0;
-      }
-    }
-
-    begin_op();
-    iput(curproc->cwd);
-    end_op();
-    curproc->cwd = 0;
-    // Parent might be sleeping in wait().
-    acquire(&ptable.lock);
-
-    wakeup1(curproc->parent);
-    // Pass abandoned children to init.
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent == curproc){
-        p->parent = initproc;
-        if(p->state == ZOMBIE)
-          wakeup1(initproc);
-      }
-    }
-  }
-
-
-  curthread->state = T_ZOMBIE;
-  curproc->state = ZOMBIE;
-  sched();
-  panic("zombie (exit)");
-}
-
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
-wait(void)
-{
-  struct proc *p;
-  struct thread *t;
-  int havekids, pid;
-  struct proc *curproc = myproc();
-  
-      if(!holding(&ptable.lock)) {
-      acquire(&ptable.lock);
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  struct proc *p;
+  struct thread *t;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+  
+      if(!holding(&ptable.lock)) {
+      acquire(&ptable.lock);
     }
   for(;;){
 	// Scan through table looking for exited children.
@@ -398,18 +888,24 @@ wait(void)
 	  if(p->state == ZOMBIE){
 		pid = p->pid;
 		freevm(p->pgdir);
+		if(p->ustacks){
+		  kfree((char*)p->ustacks);
+		  p->ustacks = 0;
+		}
 		p->pid = 0;
 		p->parent = 0;
 		p->name[0] = 0;
 		p->killed = 0;
 		p->state = UNUSED;
-          // Found one.
-          for(t = p->pthreads; t < &p->pthreads[NTHREAD] ; t++){
-              if(t->state == T_ZOMBIE){
-                  t->tid = 0;
-                  kfree(t->kstack);
+          // Found one.  Reap its threads that were never joined.
+          while((t = p->threads) != 0){
+              if(t->state == SLEEPING)   // never woke up; reap it too
+                  waitqremove(t);
+              if(t->kstack){
+                  freekstack(t->kstack);
                   t->kstack=0;
               }
+              freethread(t);
           }
 		release(&ptable.lock);
 		return pid;
@@ -428,12 +924,13 @@ wait(void)
 }
 
 //PAGEBREAK: 42
-// Per-CPU process scheduler.
+// Per-CPU thread scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
-//  - swtch to start running that process
-//  - eventually that process transfers control
+//  - take the next thread off this cpu's run queue,
+//    or steal one from the busiest cpu if it is empty
+//  - swtch to start running that thread
+//  - eventually that thread transfers control
 //      via swtch back to the scheduler.
 void
 scheduler(void) {
@@ -447,37 +944,43 @@ scheduler(void) {
 		// Enable interrupts on this processor.
 		sti();
 
-		// Loop over process table looking for process to run.
 		    if(!holding(&ptable.lock)) {
       acquire(&ptable.lock);
     }
-		for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-			if (p->state != INUSED) {
-				continue;
-			}
-
-			// Loop over process threads looking for thread to run
-			if(!(t = searchThreadByStatus(p, RUNNABLE)))
-				continue; // Thread not found, move to the next process
+		if ((t = pickthread(c, c)) != 0 || (t = stealthread(c)) != 0) {
+			p = t->proc;
 
-			// Switch to chosen process.  It is the process's job
+			// Switch to chosen thread.  It is the thread's job
 			// to release ptable.lock and then reacquire it
 			// before jumping back to us.
 			c->proc = p;
 			c->thread = t;
+			t->cpu = c;
+			t->waitticks += ticks - t->readyat;
 			switchuvm(p, t);
 			t->state = RUNNING;
 
 			swtch(&(c->scheduler), t->context);
 			switchkvm();
 
-			// Process is done running for now.
-			// It should have changed its p->state before coming back.
+			// Thread is done running for now.
+			// It should have changed its t->state before coming back.
 			c->proc = 0;
 			c->thread = 0;
+			release(&ptable.lock);
+			continue;
 		}
-		release(&ptable.lock);
 
+		// Nothing to run: halt until an interrupt, such as the
+		// IRQ_RESCHED that makerunnable() sends once it sees idle,
+		// instead of hammering ptable.lock.  A thread queued after
+		// the release shows up in rqlen before stihlt().
+		c->idle = 1;
+		release(&ptable.lock);
+		cli();
+		if(c->rqlen == 0)
+			stihlt();
+		c->idle = 0;
 	}
 }
 
@@ -518,11 +1021,71 @@ yield(void)
       acquire(&ptable.lock);
     }  //DOC: yieldlock
     myproc()->state = INUSED;
-  mythread()->state = RUNNABLE;
+  mythread()->nvcsw++;
+  makerunnable(mythread());
+  sched();
+  release(&ptable.lock);
+}
+
+// Called on a clock tick.  The thread used its whole tick, so
+// it drops a priority level before giving up the cpu.
+void
+preempt(void)
+{
+  struct thread *t = mythread();
+
+  acquire(&ptable.lock);
+  syncprio(t);
+  if(t->prio < NPRIO - 1)
+    t->prio++;
+  t->proc->pass += t->proc->stride;
+  t->runticks++;
+  t->nivcsw++;
+  makerunnable(t);
   sched();
   release(&ptable.lock);
 }
 
+// Give the current process tickets shares of the cpu, relative
+// to the tickets of the processes it competes with.
+int
+settickets(int tickets)
+{
+  struct proc *curproc = myproc();
+
+  if(tickets < 1 || tickets > STRIDE1)
+    return -1;
+  acquire(&ptable.lock);
+  curproc->tickets = tickets;
+  curproc->stride = STRIDE1 / tickets;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Move every thread back to its base priority, so CPU-bound
+// threads at the bottom level are not starved forever.
+// Called every BOOSTTICKS ticks.
+void
+boostprio(void)
+{
+  struct cpu *c;
+  struct thread *t;
+  int prio, n;
+
+  acquire(&ptable.lock);
+  ptable.boostgen++;
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    for(prio = 1; prio < NPRIO; prio++){
+      for(n = c->rq[prio].len; n > 0; n--){
+        t = rqpop(c, prio);
+        syncprio(t);
+        rqpush(c, t);
+      }
+    }
+  }
+  release(&ptable.lock);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -551,6 +1114,7 @@ sleep(void *chan, struct spinlock *lk)
 {
 //	struct proc *p = myproc();
   struct thread *t = mythread();
+  struct thread **pp;
   
   if(t == 0)
 	panic("sleep");
@@ -570,9 +1134,20 @@ sleep(void *chan, struct spinlock *lk)
     }  //DOC: sleeplock1
 	release(lk);
   }
-  // Go to sleep.
+  // Go to sleep, at the tail of chan's bucket so that
+  // wakeupn1() wakes the longest sleepers first.
   t->chan = chan;
   t->state = SLEEPING;
+  t->chnext = 0;
+  for(pp = waitqbucket(chan); *pp; pp = &(*pp)->chnext)
+    ;
+  *pp = t;
+
+  // Blocking before the tick is up earns a level back.
+  syncprio(t);
+  if(t->prio > t->baseprio)
+    t->prio--;
+  t->nvcsw++;
 
   sched();
 
@@ -587,23 +1162,36 @@ sleep(void *chan, struct spinlock *lk)
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
+// Wake up at most n threads sleeping on chan, oldest first,
+// or all of them if n <= 0.  Returns the number woken.
+// Only chan's wait-channel bucket is scanned.
+// The ptable lock must be held.
+static int
+wakeupn1(void *chan, int n)
+{
+  struct thread **pp, *t;
+  int woken = 0;
+
+  pp = waitqbucket(chan);
+  while((t = *pp) != 0 && (n <= 0 || woken < n)){
+    if(t->chan == chan){
+      *pp = t->chnext;
+      t->chnext = 0;
+      passcatchup(t->proc);
+      makerunnable(t);
+      woken++;
+    } else
+      pp = &t->chnext;
+  }
+  return woken;
+}
+
+// Wake up all threads sleeping on chan.
 // The ptable lock must be held.
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-  struct thread *t;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-//	if(p->state == INUSED){
-	  for(t = p->pthreads; t < &p->pthreads[NTHREAD] ; t++){
-		if(t->state == SLEEPING && t->chan == chan){
-		  t->state = RUNNABLE;
-		}
-	  }
-//	}
-  }
+  wakeupn1(chan, 0);
 }
 
 // Wake up all processes sleeping on chan.
@@ -623,24 +1211,56 @@ wakeup(void *chan)
 int
 kill(int pid) {
   struct proc *p;
-  int i;
+  struct thread *t;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      // Wake process from sleep if necessary.
-      for(i = 0; i< NTHREAD; i++)
-      {
-        p->pthreads[i].killed = 1;
-        if(p->pthreads[i].state == SLEEPING)
-          p->pthreads[i].state = RUNNABLE;
-      }
-      release(&ptable.lock);
-      return 0;
-    }
-  }
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state != UNUSED)
+      goto found;
   release(&ptable.lock);
   return -1;
+
+found:
+  // Walking p->threads needs p->lock, which comes before ptable.lock.
+  release(&ptable.lock);
+  acquire(&p->lock);
+  acquire(&ptable.lock);
+  if(p->pid != pid){
+    release(&ptable.lock);
+    release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  for(t = p->threads; t; t = t->pnext){
+    t->killed = 1;
+    // Wake thread from sleep if necessary.
+    if(t->state == SLEEPING)
+      wakethread(t);
+  }
+  release(&ptable.lock);
+  release(&p->lock);
+  return 0;
+}
+
+// Kill every other thread of the current process and wake
+// the sleeping ones so they notice.  Used by exec.
+void
+killOtherThreads(void)
+{
+  struct proc *curproc = myproc();
+  struct thread *curthread = mythread();
+  struct thread *t;
+
+  acquire(&curproc->lock);
+  acquire(&ptable.lock);
+  for(t = curproc->threads; t; t = t->pnext){
+    if(t->tid != curthread->tid)
+      t->killed = 1;
+    if(t->state == SLEEPING)
+      wakethread(t);
+  }
+  release(&ptable.lock);
+  release(&curproc->lock);
 }
 
 //PAGEBREAK: 36
@@ -664,6 +1284,8 @@ procdump(void) {
 	int i;
 	struct proc *p;
 	struct thread *t;
+	struct cpu *c;
+	struct threadstats st;
 	char *state;
 	uint pc[10];
 
@@ -674,84 +1296,125 @@ procdump(void) {
 			state = states[p->state];
 		else
 			state = "???";
-		cprintf("%d %s %s", p->pid, state, p->name);
-
-		for (t = p->pthreads; t < &p->pthreads[NTHREAD]; t++) {
-			if (t->state == T_UNUSED)
-				continue;
-			if (p->state >= 0 && p->state < NELEM(states) && tstates[p->state])
-				state = tstates[p->state];
+		procstats(p, &st);
+		cprintf("%d %s %s tickets %d pass %d run %d wait %d vcs %d ivcs %d\n",
+				p->pid, state, p->name, p->tickets, p->pass,
+				st.prunticks, st.pwaitticks, st.pnvcsw, st.pnivcsw);
+
+		for (t = p->threads; t; t = t->pnext) {
+			if (t->state >= 0 && t->state < NELEM(tstates) && tstates[t->state])
+				state = tstates[t->state];
 			else
 				state = "???";
-			cprintf("%d %s %s", p->pid, state, p->name);
-		}
-
-		if (t->state == SLEEPING) {
-			getcallerpcs((uint *) t->context->ebp + 2, pc);
-			for (i = 0; i < 10 && pc[i] != 0; i++)
-				cprintf(" %p", pc[i]);
+			cprintf("  tid %d %s prio %d cpu %d run %d wait %d vcs %d ivcs %d",
+					t->tid, state, t->prio, t->cpu ? t->cpu - cpus : -1,
+					t->runticks, t->waitticks, t->nvcsw, t->nivcsw);
+			if (t->state == SLEEPING) {
+				getcallerpcs((uint *) t->context->ebp + 2, pc);
+				for (i = 0; i < 10 && pc[i] != 0; i++)
+					cprintf(" %p", pc[i]);
+			}
+			cprintf("\n");
 		}
-		cprintf("\n");
 	}
+
+	for (c = cpus; c < &cpus[ncpu]; c++)
+		cprintf("cpu%d: runq %d steal %d stolen %d\n",
+				c - cpus, c->rqlen, c->nsteal, c->nstolen);
 }
 
-int kthread_create(void (*start_func)(), void* stack) {
+// Start a thread of the current process at start_func with the
+// user stack pointer esp.  ustack is its kernel-managed stack
+// region, or -1 if the caller supplied the stack.
+static int
+createthread(void (*start_func)(), uint esp, int ustack)
+{
   struct proc *curproc = myproc();
   struct thread *t;
-  char * sp;
-      if(!holding(&ptable.lock)) {
-      acquire(&ptable.lock);
-    }
-  t = searchThreadByStatus(myproc(), T_UNUSED);
-      if(t == 0){
-          release(&ptable.lock);
-          return -1;
-      }
-      t->killed = 0;
-//  t->state = T_EMBRYO;
-  t->tid = nexttid++;
-  t->proc = curproc;
-  release(&ptable.lock);
+  int tid;
+
+  acquire(&curproc->lock);
+  if((t = allocthread(curproc)) == 0){
+      release(&curproc->lock);
+      return -1;
+  }
+  tid = t->tid;
+  release(&curproc->lock);
 
   // Allocate kernel stack.
-  if ((t->kstack = kalloc()) == 0) {
-    t->state = T_UNUSED;
+  if (allockstack(t) < 0) {
+    acquire(&curproc->lock);
+    freethread(t);
+    wakeup(t);    // a kthread_join may already be waiting for tid
+    release(&curproc->lock);
     return -1;
   }
-  sp = t->kstack + KSTACKSIZE;
-
-  // Leave room for trap frame.
-  sp -= sizeof *t->tf;
-  t->tf = (struct trapframe *)sp;
-
-  // Set up new context to start executing at start_func,
-  // which returns to trapret.
-  sp -= 4;
-  *(uint *) sp = (uint) trapret;
-
-  sp -= sizeof *t->context;
-  t->context = (struct context *) sp;
-  memset(t->context, 0, sizeof *t->context);
-  t->context->eip = (uint)forkret;
 
+  // The new thread starts at start_func, via forkret and trapret.
   struct thread *currthread = mythread();
   *t->tf = *currthread->tf;
 
-  t->tf->esp = (uint)stack;
+  t->tf->esp = esp;
   t->tf->eip = (uint)start_func; // beginning of initcode.S
-  if(!holding(&ptable.lock)) {
-      acquire(&ptable.lock);
-  }
-  t->state = RUNNABLE;
+  t->tf->gs = 0;  // no TLS until the thread calls kthread_settls()
+  t->ustack = ustack;
+  t->affinity = currthread->affinity;
+  t->prio = t->baseprio = currthread->baseprio;
+  acquire(&ptable.lock);
+  makerunnable(t);
   release(&ptable.lock);
 
-  return t->tid;
+  return tid;
+}
+
+int kthread_create(void (*start_func)(), void* stack) {
+  return createthread(start_func, (uint)stack, -1);
+}
+
+// Like kthread_create(), but the kernel maps a stack of at least
+// size bytes with an unmapped guard page below it.  Once the
+// thread is joined, its region and pages are reused by later
+// stacks that fit.  A process has at most NUSTACK regions;
+// past that, or if memory runs out, this fails with -1, and
+// kthread_create() with a caller-allocated stack still works.
+int kthread_create_stack(void (*start_func)(), int size) {
+  struct proc *curproc = myproc();
+  struct ustack *us;
+  int i, tid;
+
+  if(size <= 0 || size > MAX_USTACK_SIZE)
+    return -1;
+
+  acquire(&curproc->lock);
+  if((i = allocustack(curproc, PGROUNDUP(size) / PGSIZE)) < 0){
+    release(&curproc->lock);
+    return -1;
+  }
+  us = &curproc->ustacks[i];
+  release(&curproc->lock);
+
+  if((tid = createthread(start_func, us->base + us->size, i)) < 0){
+    acquire(&curproc->lock);
+    freeustack(curproc, i);
+    release(&curproc->lock);
+  }
+  return tid;
 }
 
 int kthread_id() {
   return mythread()->tid;
 }
 
+// Make base the start of the calling thread's %gs segment.
+int kthread_settls(void *base) {
+  struct thread *t = mythread();
+
+  t->tls = (uint)base;
+  t->tf->gs = (SEG_UTLS << 3) | DPL_USER;
+  loadtls(t);
+  return 0;
+}
+
 void kthread_exit() {
   struct proc *curproc = myproc();
   struct thread *curthread = mythread();
@@ -759,18 +1422,17 @@ void kthread_exit() {
   int fd;
   struct thread *t;
 
-  acquire(&ptable.lock);
+  acquire(&curproc->lock);
 
   int allZombies = 1;
-  for (int i =0; i<NTHREAD; i++){
-    t = &curproc->pthreads[i];
+  for (t = curproc->threads; t; t = t->pnext){
     if(t->tid !=mythread()->tid &&( t->state != T_ZOMBIE && t->state != T_UNUSED))
       allZombies = 0;
   }
 
   if(allZombies)//this is the last thread to exit!
   {
-    release(&ptable.lock);
+    release(&curproc->lock);
     // Close all open files.
     for(fd = 0; fd < NOFILE; fd++){ //must do this part without locking!
       if(curproc->ofile[fd]){
@@ -783,9 +1445,12 @@ void kthread_exit() {
     iput(curproc->cwd);
     end_op();
     curproc->cwd = 0;
-    // Parent might be sleeping in wait().
-    acquire(&ptable.lock);
+    acquire(&curproc->lock);
+  }
 
+  acquire(&ptable.lock);
+  if(allZombies){
+    // Parent might be sleeping in wait().
     wakeup1(curproc->parent);
     // Pass abandoned children to init.
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
@@ -802,6 +1467,7 @@ void kthread_exit() {
   if(allZombies == 1) // if the proccess need to die
     curproc->state = ZOMBIE;
   wakeup1(curthread);
+  release(&curproc->lock);
   sched();
   panic("zombie (exit)");
 
@@ -815,12 +1481,10 @@ int kthread_join(int thread_id) {
     return -1;
   }
 
-      if(!holding(&ptable.lock)) {
-      acquire(&ptable.lock);
-    }
+  acquire(&currProc->lock);
 
   int found = 0;
-  for (t = currProc->pthreads; t < &currProc->pthreads[NTHREAD]; t++) {
+  for (t = currProc->threads; t; t = t->pnext) {
     if (t->tid == thread_id) {
       found = 1;
       break;
@@ -828,45 +1492,309 @@ int kthread_join(int thread_id) {
   }
 
   if (found == 0) {
-    release(&ptable.lock);
+    release(&currProc->lock);
     return -1;
   }
 
   while ((t->state != T_ZOMBIE) && (t->state != T_UNUSED)) {
-    sleep(t, &ptable.lock);
+    sleep(t, &currProc->lock);
     if (currProc->killed != 0) {
-      release(&ptable.lock);
+      release(&currProc->lock);
+      return -1;
+    }
+    // Another joiner may have reaped t meanwhile, and the pool
+    // may have handed it to a different thread or process.
+    if (t->proc != currProc || t->tid != thread_id) {
+      release(&currProc->lock);
       return -1;
     }
   }
 
+  if (t->proc != currProc || t->tid != thread_id) {
+    release(&currProc->lock);
+    return -1;
+  }
   if (t->state == T_ZOMBIE) {
-      t->tid = 0;
-      t->state = UNUSED;
-      kfree(t->kstack);
+      // Wait until the thread has left its kernel stack.
+      acquire(&ptable.lock);
+      release(&ptable.lock);
+      freekstack(t->kstack);
       t->kstack = 0;
-      t->killed = 0;
+      if (t->ustack >= 0)
+        freeustack(currProc, t->ustack);
+      currProc->runticks += t->runticks;
+      currProc->waitticks += t->waitticks;
+      currProc->nvcsw += t->nvcsw;
+      currProc->nivcsw += t->nivcsw;
+      freethread(t);
   }
+  release(&currProc->lock);
+
+  return 0;
+}
+
+// Find the live thread of p with the given tid, or 0.
+// The caller must hold p->lock.
+static struct thread*
+findthread(struct proc *p, int tid)
+{
+  struct thread *t;
+
+  for(t = p->threads; t; t = t->pnext)
+    if(t->tid == tid && t->state != T_UNUSED && t->state != T_ZOMBIE)
+      return t;
+  return 0;
+}
+
+// Restrict thread tid of the current process to the cpus in mask.
+// A thread running on a cpu it may no longer use moves at its
+// next reschedule; the caller moves at once.
+int kthread_setaffinity(int tid, int mask) {
+  struct proc *curproc = myproc();
+  struct thread *t;
+
+  if((mask & ((1 << ncpu) - 1)) == 0)
+    return -1;
+
+  acquire(&curproc->lock);
+  if((t = findthread(curproc, tid)) == 0){
+    release(&curproc->lock);
+    return -1;
+  }
+  acquire(&ptable.lock);
+  t->affinity = mask & CPUMASK_ALL;
   release(&ptable.lock);
+  release(&curproc->lock);
 
+  pushcli();
+  if(t == mythread() && !cpuallowed(t, mycpu())){
+    popcli();
+    yield();
+  } else
+    popcli();
+  return 0;
+}
+
+// Set the priority of thread tid of the current process.  It
+// moves there now, requeued at the new level if it is waiting to
+// run, and boosts return it there rather than to the top, so a
+// batch thread set to KTHREAD_PRIO_MIN stays low.
+int kthread_setpriority(int tid, int prio) {
+  struct proc *curproc = myproc();
+  struct thread *t, *t2, *prev;
+  struct cpu *c;
+  int level;
+
+  if(prio < KTHREAD_PRIO_MAX || prio > KTHREAD_PRIO_MIN)
+    return -1;
+
+  acquire(&curproc->lock);
+  if((t = findthread(curproc, tid)) == 0){
+    release(&curproc->lock);
+    return -1;
+  }
+  acquire(&ptable.lock);
+  syncprio(t);
+  // Its queue level may lag t->prio, so look at every level.
+  if((c = t->rqcpu) != 0){
+    for(level = 0; level < NPRIO; level++){
+      for(prev = 0, t2 = c->rq[level].head; t2 && t2 != t; t2 = t2->rqnext)
+        prev = t2;
+      if(t2){
+        rqunlink(c, level, prev, t);
+        break;
+      }
+    }
+  }
+  t->prio = t->baseprio = prio;
+  if(c && t->state == RUNNABLE)
+    rqpush(c, t);
+  release(&ptable.lock);
+  release(&curproc->lock);
   return 0;
 }
 
+// Return the affinity mask of thread tid of the current process.
+int kthread_getaffinity(int tid) {
+  struct proc *curproc = myproc();
+  struct thread *t;
+  int mask;
+
+  acquire(&curproc->lock);
+  if((t = findthread(curproc, tid)) == 0){
+    release(&curproc->lock);
+    return -1;
+  }
+  mask = t->affinity;
+  release(&curproc->lock);
+  return mask;
+}
+
+// Sum the accounting of p's live threads and its joined ones.
+// The caller must hold p->lock.
+static void
+procstats(struct proc *p, struct threadstats *st)
+{
+  struct thread *t;
+
+  st->nthread = p->nthread;
+  st->prunticks = p->runticks;
+  st->pwaitticks = p->waitticks;
+  st->pnvcsw = p->nvcsw;
+  st->pnivcsw = p->nivcsw;
+  for(t = p->threads; t; t = t->pnext){
+    st->prunticks += t->runticks;
+    st->pwaitticks += t->waitticks;
+    st->pnvcsw += t->nvcsw;
+    st->pnivcsw += t->nivcsw;
+  }
+}
+
+// Fill *st for the thread with the lowest tid >= tid in any
+// process and return its tid, or -1 if there is none.  Calling
+// again with the result + 1 walks every thread in the system.
+// Threads of ZOMBIE processes are skipped: wait() reaps them under
+// ptable.lock alone, so p->lock does not keep the list still.
+int
+getthreadstats(int tid, struct threadstats *st)
+{
+  struct threadstats s;
+  struct proc *p;
+  struct thread *t;
+
+  s.tid = -1;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED || p->state == ZOMBIE){
+      release(&p->lock);
+      continue;
+    }
+    for(t = p->threads; t; t = t->pnext){
+      if(t->state == T_UNUSED || t->tid < tid)
+        continue;
+      if(s.tid >= 0 && t->tid > s.tid)
+        continue;
+      s.tid = t->tid;
+      s.pid = p->pid;
+      safestrcpy(s.name, p->name, sizeof(s.name));
+      s.lastcpu = t->cpu ? t->cpu - cpus : -1;
+      s.runticks = t->runticks;
+      s.waitticks = t->waitticks;
+      s.nvcsw = t->nvcsw;
+      s.nivcsw = t->nivcsw;
+      procstats(p, &s);
+    }
+    release(&p->lock);
+  }
+  if(s.tid < 0)
+    return -1;
+  memmove(st, &s, sizeof(s));
+  return s.tid;
+}
+
+// Find the mutex named by mutex_id, or 0 if the id is stale.
+// The mtable lock must be held.
+static struct kthread_mutex_t*
+mutexlookup(int mutex_id)
+{
+	struct kthread_mutex_t *mut;
+	int slot;
+
+	if (mutex_id <= 0)
+		return 0;
+	slot = mutex_id % MAX_MUTEXES;
+	if (slot >= mtable.nslots)
+		return 0;
+	mut = &mtable.pages[slot / MUTEXES_PER_PAGE][slot % MUTEXES_PER_PAGE];
+	if (mut->state != M_INUSE || mut->mid != mutex_id)
+		return 0;
+	return mut;
+}
+
+// Remove t from mut's queue of waiting threads.
+// The mtable lock must be held.
+static void
+mutexdequeue(struct kthread_mutex_t *mut, struct thread *t)
+{
+	struct thread **pp, *prev;
+
+	prev = 0;
+	for (pp = &mut->waithead; *pp; prev = *pp, pp = &(*pp)->mnext) {
+		if (*pp == t) {
+			*pp = t->mnext;
+			if (mut->waittail == t)
+				mut->waittail = prev;
+			t->mnext = 0;
+			t->mwait = 0;
+			return;
+		}
+	}
+}
+
+// Busy-wait, without mtable.lock, while mut is held by a thread
+// that is running on another cpu.  Stops if the caller is killed.
+static void
+mutexspin(struct kthread_mutex_t *mut)
+{
+	struct thread *owner;
+	struct thread *t = mythread();
+
+	for (;;) {
+		__sync_synchronize();
+		owner = mut->thread;
+		if (!mut->locked || owner == 0 || owner == t ||
+		    owner->state != RUNNING || t->killed)
+			return;
+		asm volatile("pause");
+	}
+}
+
 int kthread_mutex_alloc(){
+	return kthread_mutex_alloc_mode(MUTEX_BLOCKING);
+}
+
+int kthread_mutex_alloc_mode(int mode){
 	struct kthread_mutex_t *mut;
+	char *page;
+	int slot;
+
+	if (mode != MUTEX_BLOCKING && mode != MUTEX_ADAPTIVE)
+		return -1;
+
 	acquire(&mtable.lock);
-	for (mut = mtable.mutex_arr; mut < &mtable.mutex_arr[MAX_MUTEXES]; mut++)
-		if (mut->state == M_UNUSED)
-			goto found;
+	if ((mut = mtable.freelist) != 0) {
+		mtable.freelist = mut->nextfree;
+		goto found;
+	}
 
-	release(&mtable.lock);
-	return -1;
+	if ((slot = mtable.nslots) >= MAX_MUTEXES) {
+		release(&mtable.lock);
+		return -1;
+	}
+	if (slot % MUTEXES_PER_PAGE == 0) {
+		if ((page = kalloc()) == 0) {
+			release(&mtable.lock);
+			return -1;
+		}
+		memset(page, 0, PGSIZE);
+		mtable.pages[slot / MUTEXES_PER_PAGE] = (struct kthread_mutex_t *) page;
+	}
+	mtable.nslots++;
+	mut = &mtable.pages[slot / MUTEXES_PER_PAGE][slot % MUTEXES_PER_PAGE];
+	mut->slot = slot;
 
 	found:
+	if (++mut->gen > MUTEX_MAXGEN)
+		mut->gen = 1;
 	mut->state = M_INUSE;
 	mut->locked = 0;
-	mut->mid = nextmid++;
-//	mut->thread = mythread();
+	mut->thread = 0;
+	mut->nextfree = 0;
+	mut->waithead = mut->waittail = 0;
+	mut->mode = mode;
+	mut->nlock = mut->ncontend = mut->nunlock = mut->nwoken = 0;
+	mut->waitcycles = mut->maxwait = 0;
+	mut->mid = mut->gen * MAX_MUTEXES + mut->slot;
 
 	release(&mtable.lock);
 
@@ -878,92 +1806,632 @@ int kthread_mutex_dealloc(int mutex_id){
 
 	acquire(&mtable.lock);
 
-	for (mut = mtable.mutex_arr; mut < &mtable.mutex_arr[MAX_MUTEXES]; mut++){
-		if (mut->mid == mutex_id){
-			if(mut->locked || mut->state == M_UNUSED || mut->thread != 0){
-                release(&mtable.lock);					// dealloc failed
-                return -1;
-			}
-
+	if ((mut = mutexlookup(mutex_id)) == 0 || mut->locked || mut->thread != 0) {
+		release(&mtable.lock);					// dealloc failed
+		return -1;
+	}
 
+	mut->state = M_UNUSED;
+	mut->thread = 0;
+	mut->mid = 0;
+	mut->locked = 0;
+	mut->nextfree = mtable.freelist;
+	mtable.freelist = mut;
+	release(&mtable.lock);
+	return 0;
+}
 
-//		    if(!(mut->locked) && mut->state != M_UNUSED && mut->thread == 0){			//we can dealloc the mutex
-				mut->state = M_UNUSED;
-				mut->thread = 0;
-				mut->mid = 0;
-				mut->locked = 0;
-				release(&mtable.lock);
-				return 0;
-//			}
-		}
+// Count a successful lock of mut; start is the rdtsc at which
+// the caller found it held, or 0 if it was free.
+// The mtable lock must be held.
+static void
+mutexlocked(struct kthread_mutex_t *mut, uint64 start)
+{
+	uint64 wait;
+
+	mut->nlock++;
+	if (start) {
+		wait = rdtsc() - start;
+		mut->ncontend++;
+		mut->waitcycles += wait;
+		if (wait > mut->maxwait)
+			mut->maxwait = wait;
 	}
-	release(&mtable.lock);					// dealloc failed
-	return -1;
 }
 
 int kthread_mutex_lock(int mutex_id){
 	struct kthread_mutex_t *mut;
 	struct thread *currThread = mythread();
+	uint64 start;
 
 	acquire(&mtable.lock);
 
+	if ((mut = mutexlookup(mutex_id)) == 0) {	// not found or unused, failed.
+		release(&mtable.lock);
+		return -1;
+	}
+	start = mut->locked ? rdtsc() : 0;
+
+	// An adaptive mutex whose owner is running on another cpu is
+	// likely to be released soon, so spin rather than pay for a
+	// sleep and a trip through the scheduler.  Stop spinning once
+	// the owner is descheduled.  A caller that already owns the
+	// mutex would spin on itself forever, so it goes on to block.
+	while (mut->mode == MUTEX_ADAPTIVE && mut->locked && mut->thread &&
+	       mut->thread != currThread &&
+	       mut->thread->state == RUNNING && !currThread->killed) {
+		release(&mtable.lock);
+		mutexspin(mut);
+		acquire(&mtable.lock);
+		if (mutexlookup(mutex_id) != mut) {		// deallocated meanwhile
+			release(&mtable.lock);
+			return -1;
+		}
+	}
 
-	for (mut = mtable.mutex_arr ; mut < &mtable.mutex_arr[MAX_MUTEXES]; mut++) {
-        if (mut->mid == mutex_id)
-			goto found;
+	if (!mut->locked) {
+		mut->locked = 1;
+		mut->thread = currThread;
+		mutexlocked(mut, start);
+		release(&mtable.lock);
+		return 0;
 	}
-	release(&mtable.lock);							// not found
-	return -1;
+	if (start == 0)
+		start = rdtsc();
+
+	// Queue up behind the other waiters. The unlocking owner
+	// hands the mutex straight to the head of the queue.
+	currThread->mwait = mut;
+	currThread->mnext = 0;
+	if (mut->waittail)
+		mut->waittail->mnext = currThread;
+	else
+		mut->waithead = currThread;
+	mut->waittail = currThread;
+
+	while (mut->thread != currThread) {
+		if (currThread->killed) {
+			mutexdequeue(mut, currThread);
+			release(&mtable.lock);
+			return -1;
+		}
+		sleep(&currThread->mwait, &mtable.lock);
+	}
+	currThread->mwait = 0;
+	mutexlocked(mut, start);
 
-	found:
+	release(&mtable.lock);
+	return 0;
+}
+
+int kthread_mutex_unlock(int mutex_id){
+	struct kthread_mutex_t *mut;
+	struct thread *next;
 
-	if (mut->state == M_UNUSED){				// the mutex is unused, failed.
+	acquire(&mtable.lock);
+
+	if ((mut = mutexlookup(mutex_id)) == 0 || !(mut->locked)) {	// not found, unused or unlocked, failed.
 		release(&mtable.lock);
 		return -1;
 	}
 
-    while (mut->locked) {
-        sleep(mut->thread, &mtable.lock);
-    }
-    mut->locked = 1;
-    mut->thread = currThread;
+	if(mut->thread == mythread()){			// the calling thread is the owner thread
+		mut->nunlock++;
+		if ((next = mut->waithead) != 0) {	// hand it to the longest waiter
+			mutexdequeue(mut, next);
+			mut->thread = next;
+			wakeup(&next->mwait);
+			mut->nwoken++;
+		} else {
+			mut->locked = 0;
+			mut->thread = 0;
+		}
+
+		release(&mtable.lock);
+		return 0;
+	}
 
 	release(&mtable.lock);
-	return 0;
+	return -1;
 }
 
-int kthread_mutex_unlock(int mutex_id){
+// Copy the counts of mutex mutex_id to *buf.
+int kthread_mutex_stats(int mutex_id, struct kthread_mutex_stats *buf){
 	struct kthread_mutex_t *mut;
-	//struct thread *currThread = mythread();
+	struct kthread_mutex_stats stats;
 
 	acquire(&mtable.lock);
+	if ((mut = mutexlookup(mutex_id)) == 0) {
+		release(&mtable.lock);
+		return -1;
+	}
+	stats.nlock = mut->nlock;
+	stats.ncontend = mut->ncontend;
+	stats.nunlock = mut->nunlock;
+	stats.nwoken = mut->nwoken;
+	stats.waitcycles = mut->waitcycles;
+	stats.maxwait = mut->maxwait;
+	release(&mtable.lock);
 
-	for (mut = mtable.mutex_arr ; mut < &mtable.mutex_arr[MAX_MUTEXES]; mut++) {
-         if (mut->mid == mutex_id)
+	memmove(buf, &stats, sizeof(stats));
+	return 0;
+}
+
+// Find the rwlock named by rwlock_id, or 0 if the id is stale.
+// The rwtable lock must be held.
+static struct kthread_rwlock_t*
+rwlocklookup(int rwlock_id)
+{
+	struct kthread_rwlock_t *rw;
+
+	if (rwlock_id <= 0)
+		return 0;
+	rw = &rwtable.rwlock[rwlock_id % MAX_RWLOCKS];
+	if (rw->state != M_INUSE || rw->rwid != rwlock_id)
+		return 0;
+	return rw;
+}
+
+int kthread_rwlock_alloc(){
+	struct kthread_rwlock_t *rw;
+
+	acquire(&rwtable.lock);
+	for (rw = rwtable.rwlock; rw < &rwtable.rwlock[MAX_RWLOCKS]; rw++)
+		if (rw->state == M_UNUSED)
 			goto found;
+
+	release(&rwtable.lock);
+	return -1;
+
+	found:
+	if (++rw->gen > 0x7fffffff / MAX_RWLOCKS)
+		rw->gen = 1;
+	rw->state = M_INUSE;
+	rw->readers = 0;
+	rw->writer = 0;
+	rw->waitwriters = 0;
+	rw->rwid = rw->gen * MAX_RWLOCKS + (rw - rwtable.rwlock);
+
+	release(&rwtable.lock);
+	return rw->rwid;
+}
+
+int kthread_rwlock_dealloc(int rwlock_id){
+	struct kthread_rwlock_t *rw;
+
+	acquire(&rwtable.lock);
+	if ((rw = rwlocklookup(rwlock_id)) == 0 || rw->readers || rw->writer || rw->waitwriters) {
+		release(&rwtable.lock);					// dealloc failed
+		return -1;
+	}
+	rw->state = M_UNUSED;
+	rw->rwid = 0;
+	release(&rwtable.lock);
+	return 0;
+}
+
+int kthread_rwlock_rdlock(int rwlock_id){
+	struct kthread_rwlock_t *rw;
+
+	acquire(&rwtable.lock);
+	if ((rw = rwlocklookup(rwlock_id)) == 0) {
+		release(&rwtable.lock);
+		return -1;
 	}
-	release(&mtable.lock);							// not found
+
+	// Wait behind an active or waiting writer.
+	while (rw->writer || rw->waitwriters) {
+		if (mythread()->killed) {
+			release(&rwtable.lock);
+			return -1;
+		}
+		sleep(rw, &rwtable.lock);
+	}
+	rw->readers++;
+
+	release(&rwtable.lock);
+	return 0;
+}
+
+int kthread_rwlock_wrlock(int rwlock_id){
+	struct kthread_rwlock_t *rw;
+
+	acquire(&rwtable.lock);
+	if ((rw = rwlocklookup(rwlock_id)) == 0) {
+		release(&rwtable.lock);
+		return -1;
+	}
+
+	rw->waitwriters++;
+	while (rw->writer || rw->readers) {
+		if (mythread()->killed) {
+			if (--rw->waitwriters == 0)
+				wakeup(rw);			// let blocked readers in
+			release(&rwtable.lock);
+			return -1;
+		}
+		sleep(rw, &rwtable.lock);
+	}
+	rw->waitwriters--;
+	rw->writer = mythread();
+
+	release(&rwtable.lock);
+	return 0;
+}
+
+// Release a read hold, or the write hold if the caller owns it.
+int kthread_rwlock_unlock(int rwlock_id){
+	struct kthread_rwlock_t *rw;
+
+	acquire(&rwtable.lock);
+	if ((rw = rwlocklookup(rwlock_id)) == 0) {
+		release(&rwtable.lock);
+		return -1;
+	}
+
+	if (rw->writer) {
+		if (rw->writer != mythread()) {
+			release(&rwtable.lock);
+			return -1;
+		}
+		rw->writer = 0;
+		wakeup(rw);
+	} else if (rw->readers > 0) {
+		if (--rw->readers == 0)
+			wakeup(rw);
+	} else {
+		release(&rwtable.lock);				// not held
+		return -1;
+	}
+
+	release(&rwtable.lock);
+	return 0;
+}
+
+// Find the condition variable named by cond_id, or 0 if the id is stale.
+// The condtable lock must be held.
+static struct kthread_cond_t*
+condlookup(int cond_id)
+{
+	struct kthread_cond_t *cv;
+
+	if (cond_id <= 0)
+		return 0;
+	cv = &condtable.cond[cond_id % MAX_CONDS];
+	if (cv->state != M_INUSE || cv->cid != cond_id)
+		return 0;
+	return cv;
+}
+
+int kthread_cond_alloc(){
+	struct kthread_cond_t *cv;
+
+	acquire(&condtable.lock);
+	for (cv = condtable.cond; cv < &condtable.cond[MAX_CONDS]; cv++)
+		if (cv->state == M_UNUSED)
+			goto found;
+
+	release(&condtable.lock);
 	return -1;
 
 	found:
+	if (++cv->gen > 0x7fffffff / MAX_CONDS)
+		cv->gen = 1;
+	cv->state = M_INUSE;
+	cv->nwaiters = 0;
+	cv->cid = cv->gen * MAX_CONDS + (cv - condtable.cond);
+
+	release(&condtable.lock);
+	return cv->cid;
+}
 
-	if (mut->state == M_UNUSED || !(mut->locked)){				// the mutex is unused or unlocked, failed.
-		release(&mtable.lock);
+int kthread_cond_dealloc(int cond_id){
+	struct kthread_cond_t *cv;
+
+	acquire(&condtable.lock);
+	if ((cv = condlookup(cond_id)) == 0 || cv->nwaiters) {
+		release(&condtable.lock);				// dealloc failed
 		return -1;
 	}
+	cv->state = M_UNUSED;
+	cv->cid = 0;
+	release(&condtable.lock);
+	return 0;
+}
 
-	if(mut->locked){
-        if(mut->thread == mythread()){			// the calling thread is the owner thread
-            mut->locked = 0;
-            wakeup(mut->thread);
-            mut->thread = 0;
+// Atomically unlock mutex_id and sleep until signalled, then
+// lock mutex_id again.  The caller must hold mutex_id, and should
+// re-check its condition on return.
+int kthread_cond_wait(int cond_id, int mutex_id){
+	struct kthread_cond_t *cv;
 
+	acquire(&condtable.lock);
+	if ((cv = condlookup(cond_id)) == 0) {
+		release(&condtable.lock);
+		return -1;
+	}
 
-            release(&mtable.lock);
-            return 0;
-        }
+	// A signal needs condtable.lock, which we hold until sleep
+	// has taken ptable.lock, so none is missed after the unlock.
+	if (kthread_mutex_unlock(mutex_id) < 0) {
+		release(&condtable.lock);
+		return -1;
 	}
+	cv->nwaiters++;
+	sleep(cv, &condtable.lock);
+	cv->nwaiters--;
+	release(&condtable.lock);
 
-	release(&mtable.lock);
+	if (kthread_mutex_lock(mutex_id) < 0 || mythread()->killed)
+		return -1;
+	return 0;
+}
+
+// Wake the longest waiting thread, or all of them if all is set.
+static int
+condwake(int cond_id, int all)
+{
+	struct kthread_cond_t *cv;
+
+	acquire(&condtable.lock);
+	if ((cv = condlookup(cond_id)) == 0) {
+		release(&condtable.lock);
+		return -1;
+	}
+	if (cv->nwaiters) {
+		acquire(&ptable.lock);
+		wakeupn1(cv, all ? 0 : 1);
+		release(&ptable.lock);
+	}
+	release(&condtable.lock);
+	return 0;
+}
+
+int kthread_cond_signal(int cond_id){
+	return condwake(cond_id, 0);
+}
+
+int kthread_cond_broadcast(int cond_id){
+	return condwake(cond_id, 1);
+}
+
+// Find the semaphore named by sem_id, or 0 if the id is stale.
+// The semtable lock must be held.
+static struct kthread_sem_t*
+semlookup(int sem_id)
+{
+	struct kthread_sem_t *sem;
+
+	if (sem_id <= 0)
+		return 0;
+	sem = &semtable.sem[sem_id % MAX_SEMS];
+	if (sem->state != M_INUSE || sem->sid != sem_id)
+		return 0;
+	return sem;
+}
+
+int kthread_sem_alloc(int value){
+	struct kthread_sem_t *sem;
+
+	if (value < 0)
+		return -1;
+
+	acquire(&semtable.lock);
+	for (sem = semtable.sem; sem < &semtable.sem[MAX_SEMS]; sem++)
+		if (sem->state == M_UNUSED)
+			goto found;
+
+	release(&semtable.lock);
 	return -1;
+
+	found:
+	if (++sem->gen > 0x7fffffff / MAX_SEMS)
+		sem->gen = 1;
+	sem->state = M_INUSE;
+	sem->value = value;
+	sem->nwaiters = 0;
+	sem->sid = sem->gen * MAX_SEMS + (sem - semtable.sem);
+
+	release(&semtable.lock);
+	return sem->sid;
+}
+
+int kthread_sem_dealloc(int sem_id){
+	struct kthread_sem_t *sem;
+
+	acquire(&semtable.lock);
+	if ((sem = semlookup(sem_id)) == 0 || sem->nwaiters) {
+		release(&semtable.lock);				// dealloc failed
+		return -1;
+	}
+	sem->state = M_UNUSED;
+	sem->sid = 0;
+	release(&semtable.lock);
+	return 0;
+}
+
+// Take one unit, sleeping until one is available.
+int kthread_sem_down(int sem_id){
+	struct kthread_sem_t *sem;
+
+	acquire(&semtable.lock);
+	if ((sem = semlookup(sem_id)) == 0) {
+		release(&semtable.lock);
+		return -1;
+	}
+
+	while (sem->value == 0) {
+		if (mythread()->killed) {
+			release(&semtable.lock);
+			return -1;
+		}
+		sem->nwaiters++;
+		sleep(sem, &semtable.lock);
+		sem->nwaiters--;
+	}
+	sem->value--;
+
+	release(&semtable.lock);
+	return 0;
+}
+
+// Return one unit and wake one waiter to take it.
+int kthread_sem_up(int sem_id){
+	struct kthread_sem_t *sem;
+
+	acquire(&semtable.lock);
+	if ((sem = semlookup(sem_id)) == 0) {
+		release(&semtable.lock);
+		return -1;
+	}
+
+	sem->value++;
+	if (sem->nwaiters) {
+		acquire(&ptable.lock);
+		wakeupn1(sem, 1);
+		release(&ptable.lock);
+	}
+
+	release(&semtable.lock);
+	return 0;
+}
+
+// Find the barrier named by barrier_id, or 0 if the id is stale.
+// The barriertable lock must be held.
+static struct kthread_barrier_t*
+barrierlookup(int barrier_id)
+{
+	struct kthread_barrier_t *b;
+
+	if (barrier_id <= 0)
+		return 0;
+	b = &barriertable.barrier[barrier_id % MAX_BARRIERS];
+	if (b->state != M_INUSE || b->bid != barrier_id)
+		return 0;
+	return b;
+}
+
+int kthread_barrier_alloc(int nthreads){
+	struct kthread_barrier_t *b;
+
+	if (nthreads < 1)
+		return -1;
+
+	acquire(&barriertable.lock);
+	for (b = barriertable.barrier; b < &barriertable.barrier[MAX_BARRIERS]; b++)
+		if (b->state == M_UNUSED)
+			goto found;
+
+	release(&barriertable.lock);
+	return -1;
+
+	found:
+	if (++b->gen > 0x7fffffff / MAX_BARRIERS)
+		b->gen = 1;
+	b->state = M_INUSE;
+	b->nthreads = nthreads;
+	b->count = 0;
+	b->nwaiters = 0;
+	b->bid = b->gen * MAX_BARRIERS + (b - barriertable.barrier);
+
+	release(&barriertable.lock);
+	return b->bid;
+}
+
+int kthread_barrier_dealloc(int barrier_id){
+	struct kthread_barrier_t *b;
+
+	acquire(&barriertable.lock);
+	if ((b = barrierlookup(barrier_id)) == 0 || b->count || b->nwaiters) {
+		release(&barriertable.lock);			// dealloc failed
+		return -1;
+	}
+	b->state = M_UNUSED;
+	b->bid = 0;
+	release(&barriertable.lock);
+	return 0;
+}
+
+// Sleep until nthreads threads have called kthread_barrier_wait,
+// then release them all with a single wakeup.  Returns 1 in the
+// thread that opened the barrier and 0 in the others.
+int kthread_barrier_wait(int barrier_id){
+	struct kthread_barrier_t *b;
+	uint phase;
+
+	acquire(&barriertable.lock);
+	if ((b = barrierlookup(barrier_id)) == 0) {
+		release(&barriertable.lock);
+		return -1;
+	}
+
+	phase = b->phase;
+	if (++b->count == b->nthreads) {
+		b->count = 0;
+		b->phase++;
+		wakeup(b);
+		release(&barriertable.lock);
+		return 1;
+	}
+
+	while (b->phase == phase) {
+		if (mythread()->killed) {
+			b->count--;
+			release(&barriertable.lock);
+			return -1;
+		}
+		b->nwaiters++;
+		sleep(b, &barriertable.lock);
+		b->nwaiters--;
+	}
+
+	release(&barriertable.lock);
+	return 0;
+}
+
+// Kernel address of the user word at addr in the current process,
+// used as the sleep channel for futex_wait/futex_wake.  Distinct
+// processes never share a page, so this is unique per process.
+static int*
+futexaddr(int *addr)
+{
+  char *ka;
+
+  if((uint)addr % sizeof(int) != 0)
+    return 0;
+  if((ka = uva2ka(myproc()->pgdir, (char*)addr)) == 0)
+    return 0;
+  return (int*)(ka + ((uint)addr % PGSIZE));
+}
+
+// Sleep until futex_wake(addr) if *addr still holds expected.
+// Returns -1 at once if it does not, so the caller re-checks.
+int futex_wait(int *addr, int expected) {
+  int *kaddr;
+
+  if((kaddr = futexaddr(addr)) == 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  if(*kaddr != expected || mythread()->killed){
+    release(&ptable.lock);
+    return -1;
+  }
+  sleep(kaddr, &ptable.lock);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake at most n threads waiting in futex_wait(addr).
+// Returns the number woken.
+int futex_wake(int *addr, int n) {
+  int *kaddr, woken;
+
+  if((kaddr = futexaddr(addr)) == 0 || n <= 0)
+    return -1;
+
+  acquire(&ptable.lock);
+  woken = wakeupn1(kaddr, n);
+  release(&ptable.lock);
+  return woken;
 }
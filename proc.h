@@ -1,4 +1,13 @@
-#define NTHREAD 16  //  the max num of threads each proc can hold.
+#define NTHREAD 512  //  the max num of threads each proc can hold.
+
+// Per-CPU queue of RUNNABLE threads at one priority level,
+// linked through thread.rqnext.  Protected by ptable.lock.
+struct runqueue {
+  struct thread *head;         // Next thread to run
+  struct thread *tail;         // Most recently queued thread
+  int len;                     // Number of queued threads
+};
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -10,6 +19,13 @@ struct cpu {
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
   struct thread *thread;       // The thread running on this cpu or null
+  struct runqueue rq[NPRIO];   // Threads waiting to run on this cpu, by priority
+  int rqlen;                   // Threads in all of rq
+  volatile int idle;           // Halted in scheduler(); wake with IRQ_RESCHED
+  uint nsteal;                 // Threads this cpu stole from other run queues
+  uint nstolen;                // Threads other cpus stole from this run queue
+  char *kstacks[NKSTACKCACHE]; // Freed kernel stacks ready for reuse
+  int nkstack;                 // Number of stacks in kstacks
 };
 
   enum threadstate { T_UNUSED, T_EMBRYO, SLEEPING, RUNNABLE, RUNNING, T_ZOMBIE };
@@ -23,11 +39,46 @@ struct thread {
   int tid;                     // thread ID
   struct proc *proc;           // the proc
   int killed;                  // If 1 have been killed
+  struct cpu *cpu;             // Cpu this thread last ran on, or null
+  struct cpu *rqcpu;           // Cpu whose run queue holds this thread, or null
+  struct thread *rqnext;       // Next thread in that run queue
+  struct thread *chnext;       // Next thread in the same wait-channel bucket
+  struct kthread_mutex_t *mwait;  // Mutex this thread is queued on, or null
+  struct thread *mnext;        // Next thread queued on that mutex
+  struct thread *pnext;        // Next thread of the same proc, or in the free pool
+  int ustack;                  // Index in proc->ustacks of its user stack, or -1
+  uint tls;                    // Base of the %gs segment in user space
+  uint affinity;               // Bit i set if the thread may run on cpus[i]
+  int prio;                    // MLFQ level, 0 runs first
+  int baseprio;                // Highest level it may reach, from kthread_setpriority()
+  uint boostgen;               // Priority boosts seen, see boostprio()
+  uint runticks;               // Clock ticks spent RUNNING
+  uint waitticks;              // Clock ticks spent RUNNABLE
+  uint readyat;                // ticks when it last became RUNNABLE
+  uint nvcsw;                  // Voluntary context switches
+  uint nivcsw;                 // Involuntary context switches
 };
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
 
+// A user stack region handed out by kthread_create_stack().
+// The page below base is never mapped, so an overflow faults.
+// Only the top npages are mapped.  kthread_join() leaves them
+// mapped, since another cpu running a thread of the process may
+// still cache them, and the region and its pages go to the next
+// thread whose stack fits in it.
+struct ustack {
+  uint base;                   // Lowest stack address, just above the guard page
+  uint size;                   // Bytes of address space above base
+  uint npages;                 // Pages mapped at the top
+  int inuse;                   // Held by a thread that has not been joined
+};
+
+// A process's regions live in one page, allocated by its first
+// kthread_create_stack().
+#define NUSTACK (PGSIZE / sizeof(struct ustack))
+
 //PAGEBREAK: 17
 // Saved registers for kernel context switches.
 // Don't need to save all the segment registers (%cs, etc),
@@ -60,7 +111,17 @@ struct proc {
   struct file *ofile[NOFILE];      // Open files
   struct inode *cwd;               // Current directory
   char name[16];                   // Process name (debugging)
-  struct thread pthreads[NTHREAD];  // Process threads table
+  struct spinlock lock;            // Protects the threads list
+  struct thread *threads;          // Process threads, linked through pnext
+  int nthread;                     // Number of threads in threads
+  int tickets;                     // Share of the cpu, for stride scheduling
+  uint stride;                     // STRIDE1 / tickets
+  uint pass;                       // Stride pass, see passbefore()
+  uint runticks;                   // Totals of joined threads, for getthreadstats()
+  uint waitticks;
+  uint nvcsw;
+  uint nivcsw;
+  struct ustack *ustacks;          // NUSTACK user stacks, or 0 if none yet
 };
 
 enum mutexstate { M_UNUSED, M_INUSE };
@@ -72,7 +133,60 @@ struct kthread_mutex_t {
   int mid;                        // Mutex id
   enum mutexstate state;           // Mutex state
   struct thread *thread;          // the owner thread
+  int slot;                       // Index in mtable, low part of mid
+  uint gen;                       // Bumped on each alloc, high part of mid
+  struct kthread_mutex_t *nextfree;  // Next slot on mtable's free list
+  struct thread *waithead;        // First thread waiting for the mutex
+  struct thread *waittail;        // Last thread waiting for the mutex
+  int mode;                       // MUTEX_BLOCKING or MUTEX_ADAPTIVE
+
+  // For kthread_mutex_stats(), see kthread.h.
+  uint nlock;
+  uint ncontend;
+  uint nunlock;
+  uint nwoken;
+  uint64 waitcycles;
+  uint64 maxwait;
+
+};
+
+// Reader-writer lock.  Writers are preferred: once a writer waits,
+// new readers wait behind it.
+struct kthread_rwlock_t {
+  int rwid;                       // Rwlock id, gen * MAX_RWLOCKS + slot
+  uint gen;                       // Bumped on each alloc
+  enum mutexstate state;          // Rwlock state
+  int readers;                    // Threads holding it for reading
+  struct thread *writer;          // Thread holding it for writing
+  int waitwriters;                // Writers sleeping in wrlock
+};
+
+// Condition variable, used together with a kthread mutex.
+struct kthread_cond_t {
+  int cid;                        // Cond id, gen * MAX_CONDS + slot
+  uint gen;                       // Bumped on each alloc
+  enum mutexstate state;          // Cond state
+  int nwaiters;                   // Threads sleeping in kthread_cond_wait
+};
+
+// Counting semaphore.
+struct kthread_sem_t {
+  int sid;                        // Semaphore id, gen * MAX_SEMS + slot
+  uint gen;                       // Bumped on each alloc
+  enum mutexstate state;          // Semaphore state
+  int value;                      // Units available to kthread_sem_down
+  int nwaiters;                   // Threads sleeping in kthread_sem_down
+};
 
+// Reusable barrier for a fixed number of threads.
+struct kthread_barrier_t {
+  int bid;                        // Barrier id, gen * MAX_BARRIERS + slot
+  uint gen;                       // Bumped on each alloc
+  enum mutexstate state;          // Barrier state
+  int nthreads;                   // Threads that must arrive
+  int count;                      // Threads arrived in this phase
+  uint phase;                     // Bumped each time the barrier opens
+  int nwaiters;                   // Threads sleeping in kthread_barrier_wait
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -80,5 +194,3 @@ struct kthread_mutex_t {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
-
-void finishAllThreads();
\ No newline at end of file
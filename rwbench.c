@@ -0,0 +1,86 @@
+// Compare read-side scaling of kthread_rwlock against kthread_mutex:
+// 1, 2, 4 and 8 threads repeatedly lock, scan a shared table and unlock.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kthread.h"
+
+#define NTHREADS 8
+#define ITERS 2000
+#define TABLESZ 256
+
+int table[TABLESZ];
+int lockid;
+int usemutex;
+volatile int sink;
+
+void
+reader(void)
+{
+  int i, j, sum;
+
+  sum = 0;
+  for(i = 0; i < ITERS; i++){
+    if(usemutex)
+      kthread_mutex_lock(lockid);
+    else
+      kthread_rwlock_rdlock(lockid);
+    for(j = 0; j < TABLESZ; j++)
+      sum += table[j];
+    if(usemutex)
+      kthread_mutex_unlock(lockid);
+    else
+      kthread_rwlock_unlock(lockid);
+  }
+  sink = sum;
+  kthread_exit();
+}
+
+// Run n readers to completion; return the elapsed ticks.
+int
+run(int n, int mutex)
+{
+  char *stacks[NTHREADS];
+  int tids[NTHREADS];
+  int i, start;
+
+  usemutex = mutex;
+  lockid = mutex ? kthread_mutex_alloc() : kthread_rwlock_alloc();
+  if(lockid < 0){
+    printf(1, "rwbench: lock alloc failed\n");
+    exit();
+  }
+
+  start = uptime();
+  for(i = 0; i < n; i++){
+    stacks[i] = malloc(MAX_STACK_SIZE);
+    tids[i] = kthread_create(reader, stacks[i] + MAX_STACK_SIZE);
+  }
+  for(i = 0; i < n; i++){
+    kthread_join(tids[i]);
+    free(stacks[i]);
+  }
+  start = uptime() - start;
+
+  if(mutex)
+    kthread_mutex_dealloc(lockid);
+  else
+    kthread_rwlock_dealloc(lockid);
+  return start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i;
+
+  for(i = 0; i < TABLESZ; i++)
+    table[i] = i;
+
+  printf(1, "rwbench: %d lock/scan/unlock rounds per thread\n", ITERS);
+  for(n = 1; n <= NTHREADS; n *= 2)
+    printf(1, "%d readers: rwlock %d ticks, mutex %d ticks\n",
+           n, run(n, 0), run(n, 1));
+  exit();
+}
@@ -8,6 +8,76 @@
 #include "mmu.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "lockstat.h"
+
+// Contention counts, one entry per lock name.  Entries are never
+// removed, so a freed lock (e.g. a pipe's) leaves no dangling pointer.
+// lockstats.guard is taken with a bare xchg, since initlock cannot
+// take a spinlock, but with interrupts off, as acquire does, so
+// its holder is never preempted.  The counts themselves are updated while holding
+// the lock they describe, so they are exact for singleton locks like
+// ptable and approximate for names shared by many locks.
+// acquire and release only time locks while lockstats.on is set,
+// by setlockstat(), so an unprofiled kernel pays no rdtsc.
+static struct {
+  uint guard;
+  int on;
+  int n;
+  struct lockstat stat[NLOCKSTAT];
+} lockstats;
+
+static struct lockstat*
+lockstatfor(char *name)
+{
+  struct lockstat *ls;
+
+  // Locks initialised before mpinit() run on one cpu with
+  // interrupts off, and mycpu() does not work yet.
+  if(ncpu)
+    pushcli();
+  while(xchg(&lockstats.guard, 1) != 0)
+    ;
+  for(ls = lockstats.stat; ls < &lockstats.stat[lockstats.n]; ls++)
+    if(strncmp(ls->name, name, sizeof(ls->name) - 1) == 0)
+      goto found;
+  if(lockstats.n == NLOCKSTAT){
+    ls = 0;
+    goto out;
+  }
+  ls = &lockstats.stat[lockstats.n++];
+  safestrcpy(ls->name, name, sizeof(ls->name));
+found:
+  ls->nlock++;
+out:
+  __sync_synchronize();
+  asm volatile("movl $0, %0" : "+m" (lockstats.guard) : );
+  if(ncpu)
+    popcli();
+  return ls;
+}
+
+// Turn timing of acquire and release on or off; return
+// whether it was on.
+int
+setlockstat(int on)
+{
+  int was;
+
+  was = lockstats.on;
+  lockstats.on = on != 0;
+  return was;
+}
+
+// Copy up to n lockstat entries to buf; return how many.
+int
+getlockstat(struct lockstat *buf, int n)
+{
+  if(n > lockstats.n)
+    n = lockstats.n;
+  if(n > 0)
+    memmove(buf, lockstats.stat, n * sizeof(*buf));
+  return n;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -15,6 +85,8 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->holdstart = 0;
+  lk->stat = lockstatfor(name);
 }
 
 // Acquire the lock.
@@ -24,13 +96,25 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 start, spin;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
   // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  spin = 0;
+  if(xchg(&lk->locked, 1) != 0){
+    if(lockstats.on){
+      start = rdtsc();
+      while(xchg(&lk->locked, 1) != 0)
+        ;
+      spin = rdtsc() - start;
+    } else {
+      while(xchg(&lk->locked, 1) != 0)
+        ;
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +124,33 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->stat && lockstats.on){
+    lk->stat->nacquire++;
+    if(spin){
+      lk->stat->ncontend++;
+      lk->stat->spincycles += spin;
+    }
+    lk->holdstart = rdtsc();
+  }
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  if(lk->holdstart){
+    hold = rdtsc() - lk->holdstart;
+    if(hold > lk->stat->maxhold)
+      lk->stat->maxhold = hold;
+    lk->holdstart = 0;
+  }
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -7,5 +7,9 @@ struct spinlock {
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For lockstat:
+  struct lockstat *stat;  // Counts shared by locks with this name, or 0
+  uint64 holdstart;       // rdtsc when the lock was acquired, or 0
 };
 
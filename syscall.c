@@ -22,6 +22,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(checkuvm(curproc->pgdir, addr, 4) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -40,6 +42,9 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) &&
+       checkuvm(curproc->pgdir, (uint)s, 1) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -66,6 +71,8 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(checkuvm(curproc->pgdir, (uint)i, size) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -112,6 +119,36 @@ extern int sys_kthread_mutex_alloc(void);
 extern int sys_kthread_mutex_dealloc(void);
 extern int sys_kthread_mutex_lock(void);
 extern int sys_kthread_mutex_unlock(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_kthread_mutex_alloc_mode(void);
+extern int sys_kthread_rwlock_alloc(void);
+extern int sys_kthread_rwlock_dealloc(void);
+extern int sys_kthread_rwlock_rdlock(void);
+extern int sys_kthread_rwlock_wrlock(void);
+extern int sys_kthread_rwlock_unlock(void);
+extern int sys_kthread_cond_alloc(void);
+extern int sys_kthread_cond_dealloc(void);
+extern int sys_kthread_cond_wait(void);
+extern int sys_kthread_cond_signal(void);
+extern int sys_kthread_cond_broadcast(void);
+extern int sys_kthread_sem_alloc(void);
+extern int sys_kthread_sem_dealloc(void);
+extern int sys_kthread_sem_down(void);
+extern int sys_kthread_sem_up(void);
+extern int sys_kthread_barrier_alloc(void);
+extern int sys_kthread_barrier_dealloc(void);
+extern int sys_kthread_barrier_wait(void);
+extern int sys_kthread_create_stack(void);
+extern int sys_kthread_settls(void);
+extern int sys_kthread_setaffinity(void);
+extern int sys_kthread_getaffinity(void);
+extern int sys_kthread_setpriority(void);
+extern int sys_settickets(void);
+extern int sys_getthreadstats(void);
+extern int sys_getlockstat(void);
+extern int sys_kthread_mutex_stats(void);
+extern int sys_setlockstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -143,6 +180,36 @@ static int (*syscalls[])(void) = {
 [SYS_kthread_mutex_dealloc]   sys_kthread_mutex_dealloc,
 [SYS_kthread_mutex_lock]  sys_kthread_mutex_lock,
 [SYS_kthread_mutex_unlock]  sys_kthread_mutex_unlock,
+[SYS_futex_wait]  sys_futex_wait,
+[SYS_futex_wake]  sys_futex_wake,
+[SYS_kthread_mutex_alloc_mode]  sys_kthread_mutex_alloc_mode,
+[SYS_kthread_rwlock_alloc]  sys_kthread_rwlock_alloc,
+[SYS_kthread_rwlock_dealloc]  sys_kthread_rwlock_dealloc,
+[SYS_kthread_rwlock_rdlock]  sys_kthread_rwlock_rdlock,
+[SYS_kthread_rwlock_wrlock]  sys_kthread_rwlock_wrlock,
+[SYS_kthread_rwlock_unlock]  sys_kthread_rwlock_unlock,
+[SYS_kthread_cond_alloc]  sys_kthread_cond_alloc,
+[SYS_kthread_cond_dealloc]  sys_kthread_cond_dealloc,
+[SYS_kthread_cond_wait]  sys_kthread_cond_wait,
+[SYS_kthread_cond_signal]  sys_kthread_cond_signal,
+[SYS_kthread_cond_broadcast]  sys_kthread_cond_broadcast,
+[SYS_kthread_sem_alloc]  sys_kthread_sem_alloc,
+[SYS_kthread_sem_dealloc]  sys_kthread_sem_dealloc,
+[SYS_kthread_sem_down]  sys_kthread_sem_down,
+[SYS_kthread_sem_up]  sys_kthread_sem_up,
+[SYS_kthread_barrier_alloc]  sys_kthread_barrier_alloc,
+[SYS_kthread_barrier_dealloc]  sys_kthread_barrier_dealloc,
+[SYS_kthread_barrier_wait]  sys_kthread_barrier_wait,
+[SYS_kthread_create_stack]  sys_kthread_create_stack,
+[SYS_kthread_settls]  sys_kthread_settls,
+[SYS_kthread_setaffinity]  sys_kthread_setaffinity,
+[SYS_kthread_getaffinity]  sys_kthread_getaffinity,
+[SYS_kthread_setpriority]  sys_kthread_setpriority,
+[SYS_settickets]  sys_settickets,
+[SYS_getthreadstats]  sys_getthreadstats,
+[SYS_getlockstat]  sys_getlockstat,
+[SYS_kthread_mutex_stats]  sys_kthread_mutex_stats,
+[SYS_setlockstat]  sys_setlockstat,
 };
 
 void
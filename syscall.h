@@ -27,4 +27,34 @@
 #define SYS_kthread_mutex_alloc  26
 #define SYS_kthread_mutex_dealloc   27
 #define SYS_kthread_mutex_lock   28
-#define SYS_kthread_mutex_unlock  29
\ No newline at end of file
+#define SYS_kthread_mutex_unlock  29
+#define SYS_futex_wait  30
+#define SYS_futex_wake  31
+#define SYS_kthread_mutex_alloc_mode  32
+#define SYS_kthread_rwlock_alloc  33
+#define SYS_kthread_rwlock_dealloc  34
+#define SYS_kthread_rwlock_rdlock  35
+#define SYS_kthread_rwlock_wrlock  36
+#define SYS_kthread_rwlock_unlock  37
+#define SYS_kthread_cond_alloc  38
+#define SYS_kthread_cond_dealloc  39
+#define SYS_kthread_cond_wait  40
+#define SYS_kthread_cond_signal  41
+#define SYS_kthread_cond_broadcast  42
+#define SYS_kthread_sem_alloc  43
+#define SYS_kthread_sem_dealloc  44
+#define SYS_kthread_sem_down  45
+#define SYS_kthread_sem_up  46
+#define SYS_kthread_barrier_alloc  47
+#define SYS_kthread_barrier_dealloc  48
+#define SYS_kthread_barrier_wait  49
+#define SYS_kthread_create_stack  50
+#define SYS_kthread_settls  51
+#define SYS_kthread_setaffinity  52
+#define SYS_kthread_getaffinity  53
+#define SYS_kthread_setpriority  54
+#define SYS_settickets  55
+#define SYS_getthreadstats  56
+#define SYS_getlockstat  57
+#define SYS_kthread_mutex_stats  58
+#define SYS_setlockstat  59
\ No newline at end of file
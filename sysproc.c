@@ -8,6 +8,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "kthread.h"
+#include "threadstats.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -80,6 +82,52 @@ sys_sleep(void)
   return 0;
 }
 
+int
+sys_settickets(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return settickets(n);
+}
+
+int
+sys_getthreadstats(void)
+{
+  int tid;
+  struct threadstats *st;
+
+  if(argint(0, &tid) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return getthreadstats(tid, st);
+}
+
+int
+sys_getlockstat(void)
+{
+  int n;
+  struct lockstat *buf;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, (void*)&buf, n*sizeof(*buf)) < 0)
+    return -1;
+  return getlockstat(buf, n);
+}
+
+int
+sys_setlockstat(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return setlockstat(on);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 int
@@ -121,10 +169,60 @@ int sys_kthread_create(void) {
   return kthread_create(start_func, stack);
 }
 
+int sys_kthread_create_stack(void) {
+  void (*start_func)();
+  int size;
+
+  if (argptr(0, (char **) &start_func, 0) < 0)
+    return -1;
+  if (argint(1, &size) < 0)
+    return -1;
+  return kthread_create_stack(start_func, size);
+}
+
+int sys_kthread_settls(void) {
+  int base;
+
+  if (argint(0, &base) < 0)
+    return -1;
+  return kthread_settls((void*)base);
+}
+
+int sys_kthread_setaffinity(void) {
+  int tid, mask;
+
+  if (argint(0, &tid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return kthread_setaffinity(tid, mask);
+}
+
+int sys_kthread_getaffinity(void) {
+  int tid;
+
+  if (argint(0, &tid) < 0)
+    return -1;
+  return kthread_getaffinity(tid);
+}
+
+int sys_kthread_setpriority(void) {
+  int tid, prio;
+
+  if (argint(0, &tid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return kthread_setpriority(tid, prio);
+}
+
 int sys_kthread_mutex_alloc(void){
   return kthread_mutex_alloc();
 }
 
+int sys_kthread_mutex_alloc_mode(void){
+  int mode;
+  if(argint(0,&mode) < 0)
+    return -1;
+  return kthread_mutex_alloc_mode(mode);
+}
+
 int sys_kthread_mutex_dealloc(void){
   int mutex_id;
   if(argint(0,&mutex_id) < 0)
@@ -142,4 +240,148 @@ int sys_kthread_mutex_unlock(void) {
   if (argint(0, &mutex_id) < 0)
     return -1;
   return kthread_mutex_unlock(mutex_id);
-}
\ No newline at end of file
+}
+
+int sys_kthread_mutex_stats(void) {
+  int mutex_id;
+  struct kthread_mutex_stats *buf;
+
+  if (argint(0, &mutex_id) < 0 || argptr(1, (void*)&buf, sizeof(*buf)) < 0)
+    return -1;
+  return kthread_mutex_stats(mutex_id, buf);
+}
+
+int sys_futex_wait(void) {
+  int *addr;
+  int expected;
+
+  if (argptr(0, (char **) &addr, sizeof(int)) < 0)
+    return -1;
+  if (argint(1, &expected) < 0)
+    return -1;
+  return futex_wait(addr, expected);
+}
+
+int sys_futex_wake(void) {
+  int *addr;
+  int n;
+
+  if (argptr(0, (char **) &addr, sizeof(int)) < 0)
+    return -1;
+  if (argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
+int sys_kthread_rwlock_alloc(void){
+  return kthread_rwlock_alloc();
+}
+
+int sys_kthread_rwlock_dealloc(void){
+  int rwlock_id;
+  if(argint(0,&rwlock_id) < 0)
+    return -1;
+  return kthread_rwlock_dealloc(rwlock_id);
+}
+
+int sys_kthread_rwlock_rdlock(void){
+  int rwlock_id;
+  if(argint(0,&rwlock_id) < 0)
+    return -1;
+  return kthread_rwlock_rdlock(rwlock_id);
+}
+
+int sys_kthread_rwlock_wrlock(void){
+  int rwlock_id;
+  if(argint(0,&rwlock_id) < 0)
+    return -1;
+  return kthread_rwlock_wrlock(rwlock_id);
+}
+
+int sys_kthread_rwlock_unlock(void){
+  int rwlock_id;
+  if(argint(0,&rwlock_id) < 0)
+    return -1;
+  return kthread_rwlock_unlock(rwlock_id);
+}
+
+int sys_kthread_cond_alloc(void){
+  return kthread_cond_alloc();
+}
+
+int sys_kthread_cond_dealloc(void){
+  int cond_id;
+  if(argint(0,&cond_id) < 0)
+    return -1;
+  return kthread_cond_dealloc(cond_id);
+}
+
+int sys_kthread_cond_wait(void){
+  int cond_id, mutex_id;
+  if(argint(0,&cond_id) < 0 || argint(1,&mutex_id) < 0)
+    return -1;
+  return kthread_cond_wait(cond_id, mutex_id);
+}
+
+int sys_kthread_cond_signal(void){
+  int cond_id;
+  if(argint(0,&cond_id) < 0)
+    return -1;
+  return kthread_cond_signal(cond_id);
+}
+
+int sys_kthread_cond_broadcast(void){
+  int cond_id;
+  if(argint(0,&cond_id) < 0)
+    return -1;
+  return kthread_cond_broadcast(cond_id);
+}
+
+int sys_kthread_sem_alloc(void){
+  int value;
+  if(argint(0,&value) < 0)
+    return -1;
+  return kthread_sem_alloc(value);
+}
+
+int sys_kthread_sem_dealloc(void){
+  int sem_id;
+  if(argint(0,&sem_id) < 0)
+    return -1;
+  return kthread_sem_dealloc(sem_id);
+}
+
+int sys_kthread_sem_down(void){
+  int sem_id;
+  if(argint(0,&sem_id) < 0)
+    return -1;
+  return kthread_sem_down(sem_id);
+}
+
+int sys_kthread_sem_up(void){
+  int sem_id;
+  if(argint(0,&sem_id) < 0)
+    return -1;
+  return kthread_sem_up(sem_id);
+}
+
+int sys_kthread_barrier_alloc(void){
+  int nthreads;
+  if(argint(0,&nthreads) < 0)
+    return -1;
+  return kthread_barrier_alloc(nthreads);
+}
+
+int sys_kthread_barrier_dealloc(void){
+  int barrier_id;
+  if(argint(0,&barrier_id) < 0)
+    return -1;
+  return kthread_barrier_dealloc(barrier_id);
+}
+
+int sys_kthread_barrier_wait(void){
+  int barrier_id;
+  if(argint(0,&barrier_id) < 0)
+    return -1;
+  return kthread_barrier_wait(barrier_id);
+}
@@ -0,0 +1,20 @@
+// Scheduler accounting returned by getthreadstats().
+// Times are in clock ticks.
+struct threadstats {
+  int tid;
+  int pid;
+  char name[16];      // Process name
+  int lastcpu;        // Cpu the thread last ran on, -1 if none yet
+  uint runticks;      // Ticks spent running
+  uint waitticks;     // Ticks spent runnable but waiting for a cpu
+  uint nvcsw;         // Voluntary context switches: sleep, yield
+  uint nivcsw;        // Involuntary context switches: preempted by the clock
+
+  // The same, summed over all threads of the process, including
+  // threads that have exited and been joined.
+  int nthread;
+  uint prunticks;
+  uint pwaitticks;
+  uint pnvcsw;
+  uint pnivcsw;
+};
@@ -0,0 +1,89 @@
+// Show per-thread and per-process scheduler accounting, sampled
+// every interval ticks: the cpu share each thread got during the
+// interval, then its running totals.
+// usage: top [interval [samples]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "threadstats.h"
+
+#define MAXT 128
+
+struct threadstats prev[MAXT], cur[MAXT];
+
+// Fill st with every thread in the system; return how many.
+int
+snapshot(struct threadstats *st)
+{
+  int n, tid;
+
+  n = 0;
+  for(tid = 0; n < MAXT && (tid = getthreadstats(tid, &st[n])) >= 0; tid++)
+    n++;
+  return n;
+}
+
+// Ticks thread s ran since the previous sample.
+uint
+ranfor(struct threadstats *s, int nprev)
+{
+  int i;
+
+  for(i = 0; i < nprev; i++)
+    if(prev[i].tid == s->tid)
+      return s->runticks - prev[i].runticks;
+  return s->runticks;
+}
+
+void
+show(int n, int nprev, int interval)
+{
+  struct threadstats *s;
+  int i, j;
+
+  printf(1, "pid tid name cpu %%cpu run wait vcs ivcs\n");
+  for(i = 0; i < n; i++){
+    s = &cur[i];
+    printf(1, "%d %d %s %d %d %d %d %d %d\n", s->pid, s->tid, s->name,
+           s->lastcpu, ranfor(s, nprev) * 100 / interval,
+           s->runticks, s->waitticks, s->nvcsw, s->nivcsw);
+  }
+
+  printf(1, "pid name threads run wait vcs ivcs\n");
+  for(i = 0; i < n; i++){
+    s = &cur[i];
+    for(j = 0; j < i; j++)
+      if(cur[j].pid == s->pid)
+        break;
+    if(j < i)
+      continue;
+    printf(1, "%d %s %d %d %d %d %d\n", s->pid, s->name, s->nthread,
+           s->prunticks, s->pwaitticks, s->pnvcsw, s->pnivcsw);
+  }
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval, samples, n, nprev, i;
+
+  interval = argc > 1 ? atoi(argv[1]) : 100;
+  samples = argc > 2 ? atoi(argv[2]) : 5;
+  if(interval <= 0 || samples <= 0){
+    printf(2, "usage: top [interval [samples]]\n");
+    exit();
+  }
+
+  nprev = snapshot(prev);
+  while(samples-- > 0){
+    sleep(interval);
+    n = snapshot(cur);
+    show(n, nprev, interval);
+    for(i = 0; i < n; i++)
+      prev[i] = cur[i];
+    nprev = n;
+  }
+  exit();
+}
@@ -1,37 +1,100 @@
 #include "types.h"
 #include "user.h"
-#include "spinlock.h"
 #include "kthread.h"
 #include "tournament_tree.h"
 
+// Times a contended node lock is retried in user space before
+// the thread blocks in futex_wait.
+#define TRNMNT_SPIN 128
+
+#define TRNMNT_MAXTHREADS (1 << 16)
+
+// Allocate arrays for nthreads threads in tree and reset the
+// node locks.  Returns 0, or -1 with tree unchanged.
+static int
+tree_arrays(trnmnt_tree* tree, int nthreads) {
+  int* threadNodes;
+  char* mem;
+
+  threadNodes = (int*) malloc(sizeof(int)*nthreads);
+  // one flat array of nthreads-1 nodes, aligned to a cache line
+  mem = malloc(sizeof(struct trnmnt_node)*(nthreads - 1) + TRNMNT_CACHELINE - 1);
+  if (threadNodes == 0 || mem == 0) {
+    if (threadNodes)
+      free(threadNodes);
+    if (mem)
+      free(mem);
+    return -1;
+  }
+  if (tree->mem) {
+    free(tree->mem);
+    free(tree->threadNodes);
+  }
+  tree->threadNodes = threadNodes;
+  tree->mem = mem;
+  tree->nodes = (struct trnmnt_node*)
+    (((uint)mem + TRNMNT_CACHELINE - 1) & ~(TRNMNT_CACHELINE - 1));
+  tree->capacity = nthreads;
+  return 0;
+}
+
+// Size tree for nthreads threads, all of them outside the tree.
+static void
+tree_reset(trnmnt_tree* tree, int nthreads) {
+  int index;
+
+  tree->size = nthreads;
+  for(index = 0; index < nthreads; index++){
+    tree->threadNodes[index] = 0;
+  }
+  for(index = 0; index < nthreads - 1; index++){
+    umutex_init(&tree->nodes[index].lock);
+  }
+}
+
 //task 3.2
 trnmnt_tree* trnmnt_tree_alloc(int depth) {
-  if (depth < 1)          //invalid depth
+  if (depth < 1 || depth > 16)          //invalid depth
     return 0;
+  return trnmnt_tree_alloc_n(1 << depth);
+}
 
+// A tree for exactly nthreads threads, with nthreads-1 nodes.
+trnmnt_tree* trnmnt_tree_alloc_n(int nthreads) {
   trnmnt_tree *tree;
-  // initialize tree space
-  tree = (trnmnt_tree*)malloc(sizeof (trnmnt_tree));
 
-  // calculate 2^depth for tree size      -1?
-  tree->size = 1;
-  int index;
-  for (index = 0; index < depth; index ++){
-    tree->size = tree->size*2;
-  }
+  if (nthreads < 1 || nthreads > TRNMNT_MAXTHREADS)
+    return 0;
 
-  // initialize thread id nodes(?)
-  tree->threadNodes = (int*) malloc(sizeof(int)*(tree->size));
-  for(index = 0; index < tree->size; index++){
-    tree->threadNodes[index] = 0;
+  // initialize tree space
+  if ((tree = (trnmnt_tree*)malloc(sizeof (trnmnt_tree))) == 0)
+    return 0;
+  tree->mem = 0;
+  tree->threadNodes = 0;
+  if (tree_arrays(tree, nthreads) < 0) {
+    free(tree);
+    return 0;
   }
+  tree_reset(tree, nthreads);
+  return tree;
+}
 
-  // initialize mutex id nodes
-  tree->mutexNodes = (int*) malloc(sizeof(int)*(tree->size - 1));
-  for(index = 0; index < tree->size - 1; index++){
-    tree->mutexNodes[index] = kthread_mutex_alloc();
+// Re-size tree for nthreads threads between phases, keeping its
+// memory when it is big enough.  Fails if any thread is still in
+// the tree.
+int trnmnt_tree_resize(struct trnmnt_tree* tree, int nthreads) {
+  int index;
+
+  if (tree == 0 || nthreads < 1 || nthreads > TRNMNT_MAXTHREADS)
+    return -1;
+  for(index = 0 ; index < tree->size; index++) {
+      if (tree->threadNodes[index] != 0)   // still in use
+          return -1;
   }
-  return tree;
+  if (nthreads > tree->capacity && tree_arrays(tree, nthreads) < 0)
+    return -1;
+  tree_reset(tree, nthreads);
+  return 0;
 }
 
 int trnmnt_tree_dealloc(struct trnmnt_tree* tree) {
@@ -39,30 +102,42 @@ int trnmnt_tree_dealloc(struct trnmnt_tree* tree) {
     return -1;
 
   int index;
-  for(index = 0 ; index < tree->size - 1; index++) {
-      int result = kthread_mutex_dealloc(tree->mutexNodes[index]);
-      if (result == -1)
+  for(index = 0 ; index < tree->size; index++) {
+      if (tree->threadNodes[index] != 0)   // still in use
           return -1;
   }
 
-  free(tree->mutexNodes);
+  free(tree->mem);
+  free(tree->threadNodes);
   free(tree);
   return 0;
 }
 
-int
-mutex_acquire(struct trnmnt_tree* tree , int ID){
-  if(kthread_mutex_lock(tree->mutexNodes[ID]) == -1){
-    return -1;
-  }
-  if(ID == 0){
-    return 0;
+// Spin a bounded number of times, reading before each attempt so
+// waiters do not bounce the line, then block in the kernel.
+static void
+node_lock(struct trnmnt_node* node){
+  int i;
+
+  for(i = 0; i < TRNMNT_SPIN; i++){
+    if(node->lock.state == 0 && umutex_trylock(&node->lock) == 0)
+      return;
+    asm volatile("pause");
   }
-  return mutex_acquire(tree , (ID -1)/2);
+  umutex_lock(&node->lock);
+}
+
+// Index of the node where thread ID starts its climb: the parent
+// of its leaf.
+static int
+leaf_node(struct trnmnt_tree* tree, int ID){
+  return (tree->size - 1 + ID - 1) / 2;
 }
 
 int
 trnmnt_tree_acquire(struct trnmnt_tree* tree,int ID){
+  int node;
+
   // check tree bounds for id
   if((ID < 0) || (ID > tree->size - 1)) {
     return -1;
@@ -73,32 +148,23 @@ trnmnt_tree_acquire(struct trnmnt_tree* tree,int ID){
     return -1;
   }
 
-  // acquire the id
+  // acquire the id, then win every node on the way to the root;
+  // a tree for one thread has no nodes
   tree->threadNodes[ID] = 1;
-  return mutex_acquire(tree , ID/2 + (tree->size - 1)/2);
-}
-
-
-int
-mutex_release( trnmnt_tree* tree , int stopCondition, int ID){
-        // release the final lock
-    if( ID == stopCondition){
-        return kthread_mutex_unlock(tree->mutexNodes[ID]);
-    }
-        //  release all fathers
-    if( mutex_release(tree, stopCondition, (ID-1)/2) == -1){
-        return -1;
-    }
-        //release curr ID
-    if(kthread_mutex_unlock(tree->mutexNodes[ID]) == -1){
-        return -1;
-    }
-
+  if(tree->size == 1)
     return 0;
+  for(node = leaf_node(tree, ID); ; node = (node - 1) / 2){
+    node_lock(&tree->nodes[node]);
+    if(node == 0)
+      break;
+  }
+  return 0;
 }
 
-
 int trnmnt_tree_release(struct trnmnt_tree* tree,int ID) {
+    int path[32];
+    int node, n;
+
     if((ID < 0) || (ID > tree->size - 1)) {
         return -1;
     }
@@ -107,5 +173,16 @@ int trnmnt_tree_release(struct trnmnt_tree* tree,int ID) {
         return -1;
     }
 
-    return mutex_release(tree, 0, ID/2 + (tree->size - 1)/2);
+    // release from the root down to the leaf node
+    n = 0;
+    for(node = leaf_node(tree, ID); tree->size > 1; node = (node - 1) / 2){
+        path[n++] = node;
+        if(node == 0)
+            break;
+    }
+    while(n > 0)
+        umutex_unlock(&tree->nodes[path[--n]].lock);
+
+    tree->threadNodes[ID] = 0;
+    return 0;
 }
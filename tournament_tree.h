@@ -1,12 +1,29 @@
 
+// Each internal node is a user-space lock padded to its own cache
+// line, so threads spinning on different nodes do not share lines.
+#define TRNMNT_CACHELINE 64
+
+struct trnmnt_node {
+  umutex_t lock;
+  char pad[TRNMNT_CACHELINE - sizeof(umutex_t)];
+};
+
+// A tree for size threads has size-1 nodes in heap order: the
+// children of node i are 2i+1 and 2i+2, and thread ID is leaf
+// size-1+ID.  When size is not a power of two the leaves sit on two
+// levels, so some threads climb one node fewer.
 typedef struct trnmnt_tree {
-  int size;
-  int* mutexNodes;      //mutexes id
-  int* threadNodes;     //thread id nodes
+  int size;                    // threads, IDs 0..size-1
+  int capacity;                // threads the allocated arrays can hold
+  struct trnmnt_node* nodes;   // size-1 nodes, root first
+  char* mem;                   // malloc'd block nodes is aligned within
+  int* threadNodes;            // 1 while thread ID is acquiring or holding the tree
 }trnmnt_tree;
 
 
 struct trnmnt_tree* trnmnt_tree_alloc(int depth);
+struct trnmnt_tree* trnmnt_tree_alloc_n(int nthreads);
+int trnmnt_tree_resize(struct trnmnt_tree* tree, int nthreads);
 int trnmnt_tree_dealloc(struct trnmnt_tree* tree);
 int trnmnt_tree_acquire(struct trnmnt_tree* tree,int ID);
 int trnmnt_tree_release(struct trnmnt_tree* tree,int ID);
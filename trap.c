@@ -54,9 +54,15 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      if(ticks % BOOSTTICKS == 0)
+        boostprio();
     }
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Just wakes the cpu from hlt in scheduler().
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -105,7 +111,7 @@ trap(struct trapframe *tf)
   // If interrupts were on while locks held, would need to check nlock.
   if(mythread() && mythread()->state == RUNNING &&
      tf->trapno == T_IRQ0+IRQ_TIMER)
-    yield();
+    preempt();
 
   // Check if the process has been killed since we yielded
     if(mythread() && mythread()->killed && (tf->cs&3) == DPL_USER)
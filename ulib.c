@@ -104,3 +104,21 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Thread-local storage.  The first word of a TLS block points
+// to the block itself, so tlsget() is a single %gs-relative load.
+int
+tlsset(void *block)
+{
+  *(void**)block = block;
+  return kthread_settls(block);
+}
+
+void*
+tlsget(void)
+{
+  void *block;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (block));
+  return block;
+}
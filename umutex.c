@@ -0,0 +1,45 @@
+// User-space mutex built on futex_wait/futex_wake.
+// An uncontended lock or unlock is a single xchg; the kernel
+// is entered only when a thread has to wait or be woken.
+
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+
+void
+umutex_init(umutex_t *m)
+{
+  m->state = 0;
+}
+
+void
+umutex_lock(umutex_t *m)
+{
+  if(xchg(&m->state, 1) == 0)
+    return;
+  // Contended: mark the lock as having waiters, so the
+  // holder's unlock knows to call futex_wake.
+  while(xchg(&m->state, 2) != 0)
+    futex_wait((int*)&m->state, 2);
+}
+
+// Returns 0 if the lock was taken, -1 if it is held.
+int
+umutex_trylock(umutex_t *m)
+{
+  uint old;
+
+  // cmpxchg 0 -> 1, so a held lock keeps its waiters mark.
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (old), "+m" (m->state) :
+               "r" (1), "0" (0) :
+               "cc");
+  return old == 0 ? 0 : -1;
+}
+
+void
+umutex_unlock(umutex_t *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake((int*)&m->state, 1);
+}
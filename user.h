@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct threadstats;
+struct lockstat;
+struct kthread_mutex_stats;
 
 // system calls
 int fork(void);
@@ -23,14 +26,44 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int settickets(int);
+int getthreadstats(int, struct threadstats*);
+int getlockstat(struct lockstat*, int);
+int setlockstat(int);
 int kthread_create(void (*start_func)(), void* stack);
+int kthread_create_stack(void (*start_func)(), int size);
 int kthread_id();
+int kthread_settls(void *base);
 void kthread_exit();
 int kthread_join(int thread_id);
+int kthread_setaffinity(int thread_id, int mask);
+int kthread_getaffinity(int thread_id);
+int kthread_setpriority(int thread_id, int prio);
 int kthread_mutex_alloc();
+int kthread_mutex_alloc_mode(int mode);
 int kthread_mutex_dealloc(int mutex_id);
 int kthread_mutex_lock(int mutex_id);
 int kthread_mutex_unlock(int mutex_id);
+int kthread_mutex_stats(int mutex_id, struct kthread_mutex_stats *buf);
+int kthread_rwlock_alloc();
+int kthread_rwlock_dealloc(int rwlock_id);
+int kthread_rwlock_rdlock(int rwlock_id);
+int kthread_rwlock_wrlock(int rwlock_id);
+int kthread_rwlock_unlock(int rwlock_id);
+int kthread_cond_alloc();
+int kthread_cond_dealloc(int cond_id);
+int kthread_cond_wait(int cond_id, int mutex_id);
+int kthread_cond_signal(int cond_id);
+int kthread_cond_broadcast(int cond_id);
+int kthread_sem_alloc(int value);
+int kthread_sem_dealloc(int sem_id);
+int kthread_sem_down(int sem_id);
+int kthread_sem_up(int sem_id);
+int kthread_barrier_alloc(int nthreads);
+int kthread_barrier_dealloc(int barrier_id);
+int kthread_barrier_wait(int barrier_id);
+int futex_wait(int *addr, int expected);
+int futex_wake(int *addr, int n);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -45,3 +78,14 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int tlsset(void*);
+void* tlsget(void);
+
+// umutex.c
+typedef struct umutex {
+  volatile uint state;   // 0 unlocked, 1 locked, 2 locked with waiters
+} umutex_t;
+void umutex_init(umutex_t*);
+void umutex_lock(umutex_t*);
+int umutex_trylock(umutex_t*);
+void umutex_unlock(umutex_t*);
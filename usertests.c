@@ -7,6 +7,8 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "kthread.h"
+#include "tournament_tree.h"
 
 char buf[8192];
 char name[3];
@@ -400,6 +402,280 @@ preempt(void)
   printf(1, "preempt ok\n");
 }
 
+// CPU-bound threads of one process should make similar progress:
+// the scheduler must rotate through them rather than favour some.
+#define NFAIR 4
+volatile int fairstop;
+volatile int fairnext;
+volatile uint faircount[NFAIR];
+
+void
+fairworker(void)
+{
+  int i;
+
+  i = __sync_fetch_and_add(&fairnext, 1);
+  while(!fairstop)
+    faircount[i]++;
+  kthread_exit();
+}
+
+void
+threadfair(void)
+{
+  int i, tids[NFAIR];
+  uint min, max;
+
+  printf(1, "threadfair test\n");
+  fairstop = 0;
+  fairnext = 0;
+  for(i = 0; i < NFAIR; i++){
+    faircount[i] = 0;
+    if((tids[i] = kthread_create_stack(fairworker, 4096)) < 0){
+      printf(1, "threadfair: kthread_create_stack failed\n");
+      exit();
+    }
+  }
+  sleep(100);
+  fairstop = 1;
+  for(i = 0; i < NFAIR; i++){
+    if(kthread_join(tids[i]) < 0){
+      printf(1, "threadfair: join failed\n");
+      exit();
+    }
+  }
+
+  min = max = faircount[0];
+  for(i = 1; i < NFAIR; i++){
+    if(faircount[i] < min)
+      min = faircount[i];
+    if(faircount[i] > max)
+      max = faircount[i];
+  }
+  if(min == 0 || max / min >= 4){
+    printf(1, "threadfair: unfair shares, min %d max %d\n", min, max);
+    exit();
+  }
+  printf(1, "threadfair ok\n");
+}
+
+// umutex state is 0 free, 1 held, 2 held with waiters.  Threads
+// bump a counter with a separate load and store under one umutex;
+// holders sometimes sleep, so waiters block in futex_wait, and a
+// lost wakeup would leave a join hanging.  A thread killed while
+// blocked must not keep its process from exiting.
+#define NUMUTEX 4
+#define UMUTEXITERS 500
+umutex_t umtx;
+volatile int umutexcount;
+
+void
+umutexworker(void)
+{
+  int i, c;
+
+  for(i = 0; i < UMUTEXITERS; i++){
+    umutex_lock(&umtx);
+    c = umutexcount;
+    if(i % 100 == 0)
+      sleep(1);
+    umutexcount = c + 1;
+    umutex_unlock(&umtx);
+  }
+  kthread_exit();
+}
+
+void
+umutexblocked(void)
+{
+  umutex_lock(&umtx);
+  printf(1, "umutextest: locked a held umutex\n");
+  kthread_exit();
+}
+
+void
+umutextest(void)
+{
+  int i, pid, tids[NUMUTEX];
+  char *stacks[NUMUTEX];
+
+  printf(1, "umutextest\n");
+  umutex_init(&umtx);
+  if(umtx.state != 0)
+    goto badstate;
+  umutex_lock(&umtx);
+  if(umtx.state != 1 || umutex_trylock(&umtx) == 0 || umtx.state != 1)
+    goto badstate;
+  umutex_unlock(&umtx);
+  if(umtx.state != 0 || umutex_trylock(&umtx) < 0 || umtx.state != 1)
+    goto badstate;
+  umutex_unlock(&umtx);
+
+  umutexcount = 0;
+  for(i = 0; i < NUMUTEX; i++){
+    stacks[i] = malloc(MAX_STACK_SIZE);
+    if((tids[i] = kthread_create(umutexworker, stacks[i] + MAX_STACK_SIZE)) < 0){
+      printf(1, "umutextest: kthread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < NUMUTEX; i++){
+    if(kthread_join(tids[i]) < 0){
+      printf(1, "umutextest: join failed\n");
+      exit();
+    }
+    free(stacks[i]);
+  }
+  if(umutexcount != NUMUTEX * UMUTEXITERS){
+    printf(1, "umutextest: counted %d, want %d\n",
+           umutexcount, NUMUTEX * UMUTEXITERS);
+    exit();
+  }
+  if(umtx.state != 0)
+    goto badstate;
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "umutextest: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    umutex_lock(&umtx);
+    stacks[0] = malloc(MAX_STACK_SIZE);
+    if(kthread_create(umutexblocked, stacks[0] + MAX_STACK_SIZE) < 0)
+      printf(1, "umutextest: kthread_create failed\n");
+    for(;;)
+      sleep(100);
+  }
+  sleep(10);
+  kill(pid);
+  if(wait() != pid){
+    printf(1, "umutextest: killed waiter's process not reaped\n");
+    exit();
+  }
+  printf(1, "umutextest ok\n");
+  return;
+
+badstate:
+  printf(1, "umutextest: state %d\n", umtx.state);
+  exit();
+}
+
+// Threads that hold a tournament tree must exclude each other,
+// for power-of-two and other sizes and across resizes.  The counter is bumped with a separate load and store, and now
+// and then a holder sleeps, so the waiters give up spinning and
+// block in futex_wait.
+#define TRNMNTITERS 200
+struct trnmnt_tree *trnmnt;
+volatile int trnmntnext;
+volatile int trnmntcount;
+
+void
+trnmntworker(void)
+{
+  int id, i, c;
+
+  id = __sync_fetch_and_add(&trnmntnext, 1);
+  for(i = 0; i < TRNMNTITERS; i++){
+    if(trnmnt_tree_acquire(trnmnt, id) < 0){
+      printf(1, "trnmnttest: acquire %d failed\n", id);
+      exit();
+    }
+    c = trnmntcount;
+    if(i % 50 == 0)
+      sleep(1);
+    trnmntcount = c + 1;
+    if(trnmnt_tree_release(trnmnt, id) < 0){
+      printf(1, "trnmnttest: release %d failed\n", id);
+      exit();
+    }
+  }
+  kthread_exit();
+}
+
+void
+trnmntrun(int nthreads)
+{
+  int i, tids[16];
+  char *stacks[16];
+
+  trnmntnext = 0;
+  trnmntcount = 0;
+  for(i = 0; i < nthreads; i++){
+    stacks[i] = malloc(MAX_STACK_SIZE);
+    if((tids[i] = kthread_create(trnmntworker, stacks[i] + MAX_STACK_SIZE)) < 0){
+      printf(1, "trnmnttest: kthread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < nthreads; i++){
+    if(kthread_join(tids[i]) < 0){
+      printf(1, "trnmnttest: join failed\n");
+      exit();
+    }
+    free(stacks[i]);
+  }
+  if(trnmntcount != nthreads * TRNMNTITERS){
+    printf(1, "trnmnttest: %d threads counted %d, want %d\n",
+           nthreads, trnmntcount, nthreads * TRNMNTITERS);
+    exit();
+  }
+}
+
+void
+trnmntresize(int nthreads)
+{
+  if(trnmnt_tree_resize(trnmnt, nthreads) < 0){
+    printf(1, "trnmnttest: resize to %d failed\n", nthreads);
+    exit();
+  }
+  trnmntrun(nthreads);
+}
+
+void
+trnmnttest(void)
+{
+  printf(1, "trnmnttest\n");
+  if((trnmnt = trnmnt_tree_alloc(2)) == 0){
+    printf(1, "trnmnttest: alloc failed\n");
+    exit();
+  }
+  trnmntrun(4);
+  if(trnmnt_tree_dealloc(trnmnt) < 0){
+    printf(1, "trnmnttest: dealloc failed\n");
+    exit();
+  }
+
+  // Leaves on two levels, then a larger and a smaller tree.
+  if((trnmnt = trnmnt_tree_alloc_n(5)) == 0){
+    printf(1, "trnmnttest: alloc_n failed\n");
+    exit();
+  }
+  trnmntrun(5);
+  trnmntresize(9);
+  trnmntresize(3);
+
+  // The tree can't be resized or freed while an ID is held.
+  if(trnmnt_tree_acquire(trnmnt, 2) < 0){
+    printf(1, "trnmnttest: acquire failed\n");
+    exit();
+  }
+  if(trnmnt_tree_resize(trnmnt, 6) == 0 || trnmnt_tree_dealloc(trnmnt) == 0){
+    printf(1, "trnmnttest: resize or dealloc with an ID held\n");
+    exit();
+  }
+  if(trnmnt_tree_release(trnmnt, 2) < 0){
+    printf(1, "trnmnttest: release failed\n");
+    exit();
+  }
+  trnmntresize(6);
+  if(trnmnt_tree_dealloc(trnmnt) < 0){
+    printf(1, "trnmnttest: dealloc failed\n");
+    exit();
+  }
+  printf(1, "trnmnttest ok\n");
+}
+
 // try to find any races between exit and wait
 void
 exitwait(void)
@@ -1783,6 +2059,9 @@ main(int argc, char *argv[])
   pipe1();
   preempt();
   exitwait();
+  threadfair();
+  umutextest();
+  trnmnttest();
 
   rmdot();
   fourteen();
@@ -174,10 +174,21 @@ switchuvm(struct proc *p, struct thread *t)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  loadtls(t);
   lcr3(V2P(t->proc->pgdir));  // switch to process's address space
   popcli();
 }
 
+// Point this cpu's TLS segment at t's TLS block.  %gs picks up
+// the new base when trapret reloads it on the way to user space.
+void
+loadtls(struct thread *t)
+{
+  pushcli();
+  mycpu()->gdt[SEG_UTLS] = SEG(STA_W, t->tls, 0xffffffff, DPL_USER);
+  popcli();
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -327,7 +338,7 @@ copyuvm(pde_t *pgdir, uint sz)
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;  // guard page or unused thread stack
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
@@ -345,6 +356,31 @@ bad:
   return 0;
 }
 
+// Return 0 if every page in [va, va+len) is mapped and
+// user-accessible, -1 otherwise.  Thread stacks leave unmapped
+// holes below sz, so a range check alone is not enough.
+int
+checkuvm(pde_t *pgdir, uint va, uint len)
+{
+  pte_t *pte;
+  uint a, last;
+
+  if(len == 0)
+    return 0;
+  a = PGROUNDDOWN(va);
+  last = PGROUNDDOWN(va + len - 1);
+  for(;;){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0)
+      return -1;
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+      return -1;
+    if(a == last)
+      break;
+    a += PGSIZE;
+  }
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*